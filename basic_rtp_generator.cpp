@@ -14,7 +14,7 @@ extern "C" {
 
 constexpr size_t BUFFER_SIZE = 1408; // 64 * 22
 
-BasicRtpGenerator::BasicRtpGenerator(std::string name) : SimpleBlock(std::forward<std::string>(name)) {}
+BasicRtpGenerator::BasicRtpGenerator(std::string name) : CoroutineBlock(name), Sink(std::move(name)) {}
 
 void BasicRtpGenerator::init(const std::unordered_map<std::string, std::string> &params) {
     if (!stop_condition.load(std::memory_order::relaxed)) {
@@ -59,7 +59,9 @@ void BasicRtpGenerator::init(const std::unordered_map<std::string, std::string>
             break;
         }
         default: {
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
         }
         }
     }
@@ -95,15 +97,22 @@ void BasicRtpGenerator::init(const std::unordered_map<std::string, std::string>
     initialized = true;
 }
 
-void BasicRtpGenerator::run() {
-    std::thread listen_queue(&BasicRtpGenerator::listen, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for events");
+std::vector<Task> BasicRtpGenerator::tasks() {
+    std::vector<Task> tasks;
+    tasks.push_back(generate());
+    tasks.push_back(listen());
+    return tasks;
+}
 
+Task BasicRtpGenerator::generate() {
     logger::log(logger::DEBUG, name, ": packet generator thread pid is ", gettid());
-    alignas(64) uint8_t buffer[BUFFER_SIZE];
+    uint8_t buffer[BUFFER_SIZE];
+    std::vector<MsgPtr> frame;
+    const auto period = std::chrono::duration_cast<Scheduler::Clock::duration>(std::chrono::duration<double>(1.0 / framerate));
+    // frames on a fixed grid, late ones do not push back the next ones
+    auto deadline = Scheduler::Clock::now();
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        const auto start = std::chrono::steady_clock::now();
-        auto frame_size = static_cast<uint32_t>(bitrate.load(std::memory_order::relaxed) / (8.0f * framerate));
+        auto frame_size = static_cast<uint32_t>(bitrate / (8.0f * framerate));
         buffer[0] = 0b10000000;
         buffer[1] = 0b01100000 + (type == AUDIO);
         //*reinterpret_cast<uint32_t*>(buffer + 4) = htonl(timestamp);
@@ -111,41 +120,40 @@ void BasicRtpGenerator::run() {
         // timestamp += static_cast<uint32_t>(round(clock_freq / framerate));
         *reinterpret_cast<uint32_t *>(buffer + 8) = htonl(ssrc);
         while (frame_size > 0) {
-            auto msg = std::make_shared<Msg>();
+            auto msg = Msg::create(Msg::RTP_PACKET, BUFFER_SIZE);
             msg->extra = getTimeInNtp();
-            msg->type = Msg::RTP_PACKET;
             msg->size = frame_size <= 1396 ? frame_size : 1396; // payload size
             frame_size -= msg->size;
             buffer[1] |= uint8_t{frame_size <= 0} << 7;
             *reinterpret_cast<uint16_t *>(buffer + 2) = htons(seq_number++);
             msg->size += 12; // header size
-            msg->data = std::aligned_alloc(64, msg->size);
             std::memcpy(msg->data, buffer, msg->size);
-            forward(msg);
+            frame.push_back(std::move(msg));
         }
 
-        std::this_thread::sleep_until(start + std::chrono::duration<double>(1.0 / framerate));
-    }
+        // the whole frame goes downstream at once, like an encoder output burst
+        forward(frame.data(), frame.size());
+        frame.clear();
 
-    listen_queue.join();
+        deadline += period;
+        co_await Scheduler::sleepUntil(deadline);
+    }
 }
 
-void BasicRtpGenerator::listen() {
-    logger::log(logger::DEBUG, name, ": listen thread pid is ", gettid());
-    std::shared_ptr<const Msg> msg;
+Task BasicRtpGenerator::listen() {
+    MsgPtr msg;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (!own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY)) {
-            continue;
-        }
-
-        switch (msg->type) {
-        case Msg::BITRATE_REQUEST:
-            bitrate.store(msg->size, std::memory_order::relaxed);
-            // std::cout << name << ": set bitrate to " << msg->size << std::endl;
-            break;
-        default:
-            logger::log(logger::DEBUG, name, ": got unknown message type");
-            break;
+        co_await Scheduler::messages(own_queue);
+        while (own_queue->try_dequeue(msg)) {
+            switch (msg->type) {
+            case Msg::BITRATE_REQUEST:
+                bitrate = msg->extra;
+                // std::cout << name << ": set bitrate to " << msg->extra << std::endl;
+                break;
+            default:
+                logger::log(logger::DEBUG, name, ": got unknown message type");
+                break;
+            }
         }
 
         if (uint32_t time = getTimeInNtp(); time - last_log > 2 * 65536) {
@@ -1,11 +1,12 @@
 #ifndef SCREAM_BASICRTPGENERATOR_H
 #define SCREAM_BASICRTPGENERATOR_H
 
-#include "simple_block.h"
+#include "coroutine_block.h"
 #include "sink.h"
 #include "source.h"
 
-class BasicRtpGenerator : public SimpleBlock, public Sink, public Source {
+// Frame generation and bitrate requests are two tasks of the same scheduler thread.
+class BasicRtpGenerator : public CoroutineBlock, public Sink, public Source {
   public:
     enum RtpType {
         NONE,
@@ -19,11 +20,12 @@ class BasicRtpGenerator : public SimpleBlock, public Sink, public Source {
     void init(const std::unordered_map<std::string, std::string> &params) override;
 
   private:
-    void run() override;
-    void listen();
+    std::vector<Task> tasks() override;
+    Task generate();
+    Task listen();
 
     RtpType type = NONE;
-    std::atomic<uint32_t> bitrate = 0;
+    uint32_t bitrate = 0;
     double framerate = 0;
     uint32_t ssrc = 0;
     uint16_t seq_number = 0;
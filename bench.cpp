@@ -0,0 +1,615 @@
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <thread>
+#include <vector>
+
+#include "basic_rtp_generator.h"
+#include "graph.h"
+#include "logger.h"
+#include "msg.h"
+#include "msg_queue.h"
+#include "scream_client_single.h"
+#include "server_types.h"
+#include "session_manager.h"
+#include "source.h"
+#include "tcp_framing.h"
+#include "udp_socket.h"
+
+// Micro benchmarks of the message path, "scream_bench <mode> [count]", one mode per part of it, and the scaling of the
+// server with the number of sessions, for which the count is the largest number of sessions. The figures are meant for
+// comparing builds or backends on the same host, not as absolute numbers.
+
+constexpr size_t DEFAULT_COUNT = 1000000;
+constexpr size_t PAYLOAD_SIZE = 1200;
+// between two (un)subscriptions while producers forward
+constexpr auto CHURN_PERIOD = std::chrono::microseconds(100);
+// sessions of the largest step, the count given to the mode lowers it
+constexpr size_t MAX_SESSIONS = 64;
+constexpr uint16_t SESSION_FIRST_PORT = 40000;
+// of the video each session carries, its start bitrate in session.graph
+constexpr size_t SESSION_BITRATE = 10000000;
+// the sessions settle after each step before their cpu is measured over the window
+constexpr auto SESSION_WARMUP = std::chrono::seconds(2);
+constexpr auto SESSION_WINDOW = std::chrono::seconds(5);
+
+struct Result {
+    double seconds;
+    // whole process, all threads
+    double cpu_seconds;
+};
+
+double processCpu() {
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+// resident set of the process
+size_t processRss() {
+    size_t pages = 0, resident = 0;
+    if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(statm);
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+Result measure(const std::function<void()> &f) {
+    const double cpu = processCpu();
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), processCpu() - cpu};
+}
+
+void report(std::string_view what, size_t count, const Result &result) {
+    std::cout << std::left << std::setw(40) << what << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+              << result.seconds * 1e9 / static_cast<double>(count) << " ns/op" << std::setw(10) << static_cast<double>(count) / result.seconds / 1e3
+              << " kop/s" << std::setw(8) << result.cpu_seconds * 100 / result.seconds << "% cpu" << std::endl;
+}
+
+// the message as it was before the pools and MsgPtr: a separately allocated payload behind a std::shared_ptr
+struct SharedMsg {
+    Msg::MsgType type = Msg::NONE;
+    void *data = nullptr;
+    ssize_t size = 0;
+    uint64_t extra = 0;
+
+    ~SharedMsg() {
+        if (data) {
+            free(data);
+        }
+    }
+};
+
+// takes the handle over and drops it, as the last subscriber of a message does
+template <typename Ptr> [[gnu::noinline]] void consume(Ptr &&ptr) {
+    [[maybe_unused]] const Ptr dropped = std::move(ptr);
+}
+
+// pooled messages against the allocator, on one thread and handed over to another one as a media queue does
+void benchPool(size_t count) {
+    report("malloc + free", count, measure([count] {
+               for (size_t i = 0; i < count; ++i) {
+                   void *block = std::aligned_alloc(64, Msg::BUFFER_SIZE);
+                   *static_cast<volatile uint8_t *>(block) = 0;
+                   std::free(block);
+               }
+           }));
+
+    report("make_shared<Msg> + malloc, before", count, measure([count] {
+               for (size_t i = 0; i < count; ++i) {
+                   auto msg = std::make_shared<SharedMsg>();
+                   msg->type = Msg::RAW;
+                   msg->data = std::malloc(PAYLOAD_SIZE);
+                   *static_cast<volatile uint8_t *>(msg->data) = 0;
+               }
+           }));
+
+    report("Msg::create + release", count, measure([count] {
+               for (size_t i = 0; i < count; ++i) {
+                   MsgPtr msg = Msg::create(Msg::RAW, PAYLOAD_SIZE);
+                   *static_cast<volatile uint8_t *>(msg->data) = 0;
+               }
+           }));
+
+    // freed on the consumer thread, the buffers go back to the producer through the shared list
+    MsgQueue queue("bench", 4096);
+    queue.setPolicy(Msg::RAW, MsgQueue::BLOCK);
+    report("Msg::create, released by a consumer", count, measure([count, &queue] {
+               std::thread consumer([count, &queue] {
+                   std::array<MsgPtr, 32> msgs;
+                   for (size_t received = 0; received < count;) {
+                       const size_t n = queue.wait_dequeue_bulk_timed(msgs.data(), msgs.size(), std::chrono::milliseconds(100));
+                       for (size_t i = 0; i < n; ++i) {
+                           msgs[i].reset();
+                       }
+                       received += n;
+                   }
+               });
+               for (size_t i = 0; i < count; ++i) {
+                   queue.enqueue(Msg::create(Msg::RAW, PAYLOAD_SIZE));
+               }
+               consumer.join();
+           }));
+
+    const auto stats = Msg::Pool::stats();
+    std::cout << "packet pool: hits=" << stats.hits << ", misses=" << stats.misses << ", high water=" << stats.high_water << std::endl;
+}
+
+// a handler doing nothing but dropping its messages, what is left is the cost of forward() itself
+class Discard : public MsgHandler {
+  public:
+    void handle(MsgPtr *msgs, size_t count) override { std::for_each(msgs, msgs + count, [](MsgPtr &msg) { msg.reset(); }); }
+};
+
+// one message shared by all the calls so that only the subscriber lookup, the reference counts and the delivery remain
+void benchForward(size_t count) {
+    const MsgPtr msg = Msg::create(Msg::RAW, PAYLOAD_SIZE);
+    Discard first, second;
+
+    // the handles alone, as forward() hands a message to two subscribers: a copy for the first, the original for the last
+    const std::shared_ptr<const SharedMsg> shared = std::make_shared<SharedMsg>();
+    report("shared_ptr copy + move, before", count, measure([count, &shared] {
+               for (size_t i = 0; i < count; ++i) {
+                   std::shared_ptr<const SharedMsg> copy = shared;
+                   consume(std::shared_ptr<const SharedMsg>(copy));
+                   consume(std::move(copy));
+               }
+           }));
+
+    report("MsgPtr copy + move", count, measure([count, &msg] {
+               for (size_t i = 0; i < count; ++i) {
+                   MsgPtr copy = msg;
+                   consume(MsgPtr(copy));
+                   consume(std::move(copy));
+               }
+           }));
+
+    Source one;
+    one.registerHandler(Msg::RAW, &first);
+    report("forward, one handler", count, measure([count, &one, &msg] {
+               for (size_t i = 0; i < count; ++i) {
+                   one.forward(MsgPtr(msg));
+               }
+           }));
+
+    Source two;
+    two.registerHandler(Msg::RAW, &first);
+    two.registerHandler(Msg::RAW, &second);
+    report("forward, two handlers", count, measure([count, &two, &msg] {
+               for (size_t i = 0; i < count; ++i) {
+                   two.forward(MsgPtr(msg));
+               }
+           }));
+
+    report("forward 32 at once, one handler", count, measure([count, &one, &msg] {
+               std::array<MsgPtr, 32> msgs;
+               for (size_t i = 0; i < count; i += msgs.size()) {
+                   std::fill(msgs.begin(), msgs.end(), msg);
+                   one.forward(msgs.data(), msgs.size());
+               }
+           }));
+
+    // drained by the same thread, the queue never overflows and no thread switch is measured
+    auto queue = std::make_shared<MsgQueue>("bench", 1024);
+    Source queued;
+    queued.registerQueue(Msg::RAW, queue);
+    report("forward, one queue", count, measure([count, &queued, &queue, &msg] {
+               std::array<MsgPtr, 32> msgs;
+               for (size_t i = 0; i < count; ++i) {
+                   queued.forward(MsgPtr(msg));
+                   if (i % msgs.size() == msgs.size() - 1) {
+                       queue->try_dequeue_bulk(msgs.data(), msgs.size());
+                       std::for_each(msgs.begin(), msgs.end(), [](MsgPtr &dequeued) { dequeued.reset(); });
+                   }
+               }
+           }));
+
+    report("forward 32 at once, one queue", count, measure([count, &queued, &queue, &msg] {
+               std::array<MsgPtr, 32> msgs;
+               for (size_t i = 0; i < count; i += msgs.size()) {
+                   std::fill(msgs.begin(), msgs.end(), msg);
+                   queued.forward(msgs.data(), msgs.size());
+                   queue->try_dequeue_bulk(msgs.data(), msgs.size());
+               }
+           }));
+
+    // several producers on one Source while another thread keeps (un)subscribing a queue, count messages in all; the
+    // replaced subscriber lists must be freed along the way, the resident set stays flat however long it runs
+    for (const size_t producers : {1, 2, 4, 8}) {
+        Source shared;
+        shared.registerHandler(Msg::RAW, &first);
+        std::atomic<bool> done = false;
+        std::atomic<size_t> churns = 0;
+        const size_t rss = processRss();
+        std::thread churn([&shared, &done, &churns] {
+            auto churned = std::make_shared<MsgQueue>("bench churn", 1024);
+            std::array<MsgPtr, 32> msgs;
+            while (!done.load(std::memory_order::relaxed)) {
+                shared.registerQueue(Msg::RAW, churned);
+                shared.unregisterQueue(Msg::RAW, churned);
+                churns.fetch_add(1, std::memory_order::relaxed);
+                while (churned->try_dequeue_bulk(msgs.data(), msgs.size()) > 0) {
+                    std::for_each(msgs.begin(), msgs.end(), [](MsgPtr &dequeued) { dequeued.reset(); });
+                }
+                std::this_thread::sleep_for(CHURN_PERIOD);
+            }
+        });
+
+        const size_t per_producer = count / producers;
+        report("forward, " + std::to_string(producers) + " threads, churning", per_producer * producers,
+               measure([per_producer, producers, &shared, &msg] {
+                   std::vector<std::thread> threads;
+                   for (size_t i = 0; i < producers; ++i) {
+                       threads.emplace_back([per_producer, &shared, &msg] {
+                           for (size_t j = 0; j < per_producer; ++j) {
+                               shared.forward(MsgPtr(msg));
+                           }
+                       });
+                   }
+                   std::for_each(threads.begin(), threads.end(), [](std::thread &thread) { thread.join(); });
+               }));
+        done.store(true);
+        churn.join();
+        std::cout << "  " << churns.load() << " (un)subscriptions, resident set " << std::showpos
+                  << (static_cast<ssize_t>(processRss()) - static_cast<ssize_t>(rss)) / 1024 << std::noshowpos << " kB" << std::endl;
+    }
+}
+
+// a loopback tcp connection whose receiving end is drained by a thread until the expected number of bytes came
+class TcpLoopback {
+  public:
+    explicit TcpLoopback(size_t expected) {
+        const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {.sin_family = AF_INET, .sin_port = 0, .sin_addr = {htonl(INADDR_LOOPBACK)}, .sin_zero = {}};
+        socklen_t addr_len = sizeof(addr);
+        bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), addr_len);
+        listen(listen_fd, 1);
+        getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), addr_len) < 0) {
+            throw std::runtime_error("cannot connect the loopback tcp socket");
+        }
+        const int peer_fd = accept(listen_fd, nullptr, nullptr);
+        close(listen_fd);
+
+        reader = std::thread([peer_fd, expected] {
+            std::array<uint8_t, 65536> buffer;
+            for (size_t received = 0; received < expected;) {
+                const ssize_t size = recv(peer_fd, buffer.data(), buffer.size(), 0);
+                if (size <= 0) {
+                    break;
+                }
+                received += size;
+            }
+            close(peer_fd);
+        });
+    }
+
+    ~TcpLoopback() {
+        reader.join();
+        close(fd);
+    }
+
+    int fd;
+
+  private:
+    std::thread reader;
+};
+
+// frames of a command sized payload, sendFrame against the header and the payload sent apart, all figures per frame
+void benchFraming(size_t count) {
+    constexpr size_t COMMAND_SIZE = 100;
+    const size_t expected = count * (FRAME_HEADER_SIZE + COMMAND_SIZE);
+
+    report("header + payload, 2 syscalls", count, measure([count, expected] {
+               TcpLoopback loopback(expected);
+               for (size_t i = 0; i < count; ++i) {
+                   MsgPtr msg = Msg::create(Msg::RAW, COMMAND_SIZE);
+                   msg->size = COMMAND_SIZE;
+                   const uint8_t header[FRAME_HEADER_SIZE] = {FRAME_DELIMITER, 0, COMMAND_SIZE};
+                   send(loopback.fd, header, sizeof(header), 0);
+                   send(loopback.fd, msg->data, msg->size, 0);
+               }
+           }));
+
+    report("sendFrame in headroom, 1 syscall", count, measure([count, expected] {
+               TcpLoopback loopback(expected);
+               for (size_t i = 0; i < count; ++i) {
+                   MsgPtr msg = Msg::create(Msg::RAW, COMMAND_SIZE);
+                   msg->size = COMMAND_SIZE;
+                   sendFrame(loopback.fd, msg);
+               }
+           }));
+
+    // a shared message keeps its payload untouched, header and payload are gathered instead
+    report("sendFrame gathered, 1 syscall", count, measure([count, expected] {
+               TcpLoopback loopback(expected);
+               for (size_t i = 0; i < count; ++i) {
+                   MsgPtr msg = Msg::create(Msg::RAW, COMMAND_SIZE);
+                   msg->size = COMMAND_SIZE;
+                   const MsgPtr held = msg;
+                   sendFrame(loopback.fd, msg);
+               }
+           }));
+}
+
+// counts what a socket received
+class Counter : public MsgHandler {
+  public:
+    void handle(MsgPtr *msgs, size_t count) override {
+        std::for_each(msgs, msgs + count, [](MsgPtr &msg) { msg.reset(); });
+        received.fetch_add(count, std::memory_order::relaxed);
+    }
+
+    std::atomic<size_t> received = 0;
+};
+
+// count datagrams from one UdpSocket to another over loopback, both configured with params; the time runs until the
+// last datagram came, losses are the datagrams the receiving socket buffer had no room for
+void udpLoopback(std::string_view what, size_t count, std::unordered_map<std::string, std::string> params) {
+    constexpr size_t DATAGRAM_SIZE = 1200;
+    constexpr auto IDLE_TIMEOUT = std::chrono::milliseconds(200);
+
+    params.insert({{"local_addr", "127.0.0.1"}, {"remote_addr", "127.0.0.1"}, {"queue_policy", "RAW=block"}});
+    UdpSocket sender("bench sender");
+    params["local_port"] = "47100";
+    params["remote_port"] = "47101";
+    sender.init(params);
+    UdpSocket receiver("bench receiver");
+    params["local_port"] = "47101";
+    params["remote_port"] = "47100";
+    receiver.init(params);
+    Counter counter;
+    receiver.registerHandler(Msg::RAW, &counter);
+    receiver.start();
+    sender.start();
+
+    const double cpu = processCpu();
+    const auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    for (size_t i = 0; i < count; ++i) {
+        MsgPtr msg = Msg::create(Msg::RAW, DATAGRAM_SIZE);
+        msg->size = DATAGRAM_SIZE;
+        sender.getQueue()->enqueue(std::move(msg));
+    }
+    for (size_t received = 0; received < count;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const auto now = std::chrono::steady_clock::now();
+        if (const size_t latest = counter.received.load(std::memory_order::relaxed); latest != received) {
+            received = latest;
+            last = now;
+        } else if (now - last >= IDLE_TIMEOUT) {
+            break;
+        }
+    }
+    const Result result = {std::chrono::duration<double>(last - start).count(), processCpu() - cpu};
+
+    sender.stop();
+    receiver.stop();
+    const size_t received = counter.received.load();
+    report(what, std::max<size_t>(received, 1), result);
+    std::cout << "  received " << received << " of " << count << ", " << std::setprecision(2)
+              << static_cast<double>(count - received) * 100 / static_cast<double>(count) << "% lost, " << std::setprecision(0)
+              << result.cpu_seconds * 1e9 / static_cast<double>(std::max<size_t>(received, 1)) << " ns cpu per datagram" << std::endl;
+}
+
+// recvmmsg and sendmmsg batches against one datagram per system call, and against io_uring when built in
+void benchUdp(size_t count) {
+    udpLoopback("udp, batch_size 1", count, {{"batch_size", "1"}});
+    udpLoopback("udp, batch_size 32", count, {{"batch_size", "32"}});
+#ifdef SCREAM_IO_URING
+    udpLoopback("udp, io_uring, batch_size 32", count, {{"batch_size", "32"}, {"io_backend", "io_uring"}});
+#endif
+}
+
+// the game server and proxy client ends of the sessions, apart on the loopback so that every socket has an address of its own
+const std::unordered_map<std::string, std::string> SESSION_VARIABLES = {
+    {"game_server_ip", "127.0.0.3"},
+    {"game_server_port", "9999"},
+    {"proxy_client_ip", "127.0.0.2"},
+    {"game_server_binding_ip", "127.0.0.1"},
+    {"proxy_client_binding_ip", "127.0.0.1"},
+};
+
+// the peers of the sessions, one graph each from bench_peer.graph, built from the variables read on commands, one
+// session per line of space separated key=value; the tcp command connections of the sessions are accepted on listen_fd
+// and drained. Runs in a process of its own until commands is closed, so that its cpu stays out of the figures.
+[[noreturn]] void runPeers(int commands, int listen_fd) {
+    std::atomic<bool> done = false;
+    std::thread acceptor([listen_fd, &done] {
+        std::vector<pollfd> fds = {{.fd = listen_fd, .events = POLLIN, .revents = 0}};
+        std::array<uint8_t, 4096> buffer;
+        while (!done.load(std::memory_order::relaxed)) {
+            if (poll(fds.data(), fds.size(), 100) <= 0) {
+                continue;
+            }
+            for (size_t i = fds.size(); i-- > 1;) {
+                if (fds[i].revents && recv(fds[i].fd, buffer.data(), buffer.size(), 0) <= 0) {
+                    close(fds[i].fd);
+                    fds.erase(fds.begin() + static_cast<std::ptrdiff_t>(i));
+                }
+            }
+            if (fds[0].revents & POLLIN) {
+                if (const int fd = accept(listen_fd, nullptr, nullptr); fd >= 0) {
+                    fds.push_back({.fd = fd, .events = POLLIN, .revents = 0});
+                }
+            }
+        }
+        std::for_each(fds.begin(), fds.end(), [](const pollfd &entry) { close(entry.fd); });
+    });
+
+    const auto types = [](Graph &graph) {
+        graph.registerType<BasicRtpGenerator>("basic_rtp_generator");
+        graph.registerType<UdpSocket>("udp_socket");
+        graph.registerType<ScreamClientSingle>("scream_client");
+    };
+    Graph classes;
+    if (classes.loadClasses("bench_peer.graph")) {
+        classes.start();
+    }
+    std::vector<std::unique_ptr<Graph>> peers;
+    std::string pending;
+    for (std::array<char, 1024> chunk; true;) {
+        const ssize_t size = read(commands, chunk.data(), chunk.size());
+        if (size <= 0) {
+            break;
+        }
+        pending.append(chunk.data(), size);
+        for (size_t end; (end = pending.find('\n')) != std::string::npos; pending.erase(0, end + 1)) {
+            std::unordered_map<std::string, std::string> variables = {{"bitrate", std::to_string(SESSION_BITRATE)}};
+            std::istringstream words(pending.substr(0, end));
+            for (std::string word; words >> word;) {
+                const size_t equal = word.find('=');
+                variables[word.substr(0, equal)] = equal == std::string::npos ? "" : word.substr(equal + 1);
+            }
+
+            auto peer = std::make_unique<Graph>("peer " + variables["session"] + " ");
+            types(*peer);
+            if (peer->load("bench_peer.graph", variables, &classes)) {
+                peer->start();
+                peers.push_back(std::move(peer));
+            }
+        }
+    }
+
+    for (auto it = peers.rbegin(); it != peers.rend(); ++it) {
+        (*it)->stop();
+    }
+    peers.clear();
+    classes.stop();
+    done.store(true);
+    acceptor.join();
+    _exit(0);
+}
+
+// the cpu of the server process as sessions carrying a paced video stream are added, 1, 2, 4... up to count; the peers
+// run in a child process forked before any thread is, the figures are the ones of the sessions alone
+void benchSessions(size_t count) {
+    const size_t max_sessions = std::clamp<size_t>(count, 1, MAX_SESSIONS);
+
+    // listening before any session connects its tcp client to the game server
+    const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    static constexpr int enable = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(std::stoi(SESSION_VARIABLES.at("game_server_port"))), .sin_addr = {}, .sin_zero = {}};
+    inet_pton(AF_INET, SESSION_VARIABLES.at("game_server_ip").c_str(), &addr.sin_addr);
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listen_fd, static_cast<int>(max_sessions)) < 0) {
+        std::cerr << "cannot listen as the game server -> " << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        return;
+    }
+
+    int commands[2];
+    if (pipe(commands) < 0) {
+        std::cerr << "cannot make the pipe to the peers -> " << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        return;
+    }
+    // what is buffered would be written by both processes
+    std::cout.flush();
+    const pid_t peers = fork();
+    if (peers == 0) {
+        close(commands[1]);
+        runPeers(commands[0], listen_fd);
+    }
+    close(commands[0]);
+    close(listen_fd);
+
+    SessionManager sessions("session.graph", server_types::SESSION_PORTS, SESSION_FIRST_PORT,
+                            SESSION_FIRST_PORT + max_sessions * server_types::SESSION_PORTS.size() - 1, server_types::registerTypes);
+    if (peers > 0 && sessions.start()) {
+        for (size_t target = 1; target <= max_sessions; target *= 2) {
+            while (sessions.list().size() < target) {
+                const uint32_t id = sessions.open(SESSION_VARIABLES);
+                if (id == 0) {
+                    break;
+                }
+                std::string line;
+                for (const auto &[key, val] : sessions.describe(id)) {
+                    line += key + "=" + val + " ";
+                }
+                line.back() = '\n';
+                if (write(commands[1], line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+                    std::cerr << "cannot start the peers of session " << id << std::endl;
+                }
+            }
+
+            std::this_thread::sleep_for(SESSION_WARMUP);
+            sessions.usage();
+            std::this_thread::sleep_for(SESSION_WINDOW);
+            const auto usage = sessions.usage();
+            std::cout << std::left << std::setw(40) << std::to_string(usage.sessions) + " sessions" << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(8) << usage.cpu * 100 << "% cpu" << std::setw(8) << usage.cpu * 100 / static_cast<double>(std::max<size_t>(usage.sessions, 1))
+                      << "% cpu per session" << std::endl;
+            if (usage.sessions < target) {
+                std::cerr << "only " << usage.sessions << " sessions could be opened" << std::endl;
+                break;
+            }
+        }
+    }
+
+    // the peers go first, then the sessions
+    close(commands[1]);
+    if (peers > 0) {
+        waitpid(peers, nullptr, 0);
+    }
+    sessions.stop();
+}
+
+int main(int argc, char *argv[]) {
+    logger::setMinimalLogLevel(logger::WARNING);
+    // std::shared_ptr skips its atomic operations as long as the process never had a second thread, the blocks always do
+    std::thread([] {}).join();
+    const std::vector<std::pair<std::string_view, void (*)(size_t)>> modes = {
+        {"pool", benchPool},
+        {"forward", benchForward},
+        {"framing", benchFraming},
+        {"udp", benchUdp},
+        {"sessions", benchSessions},
+    };
+
+    const std::string_view mode = argc >= 2 ? argv[1] : "";
+    const size_t count = argc >= 3 ? std::stoul(argv[2]) : DEFAULT_COUNT;
+    for (const auto &[name, bench] : modes) {
+        if (mode == name || mode == "all") {
+            std::cout << "# " << name << ", " << count << " operations" << std::endl;
+            bench(count);
+        }
+    }
+
+    if (std::none_of(modes.begin(), modes.end(), [mode](const auto &entry) { return entry.first == mode; }) && mode != "all") {
+        std::cerr << "command format is: " << argv[0] << " <all";
+        for (const auto &entry : modes) {
+            std::cerr << '|' << entry.first;
+        }
+        std::cerr << "> [count (default = " << DEFAULT_COUNT << ")]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#ifndef SCREAM_BUFFERPOOL_H
+#define SCREAM_BUFFERPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hybrid_lock.h"
+
+// Recycler for fixed-size, cache-aligned buffers. Each thread keeps a small cache of free buffers and exchanges them in
+// batches with a shared free list, so the usual pattern of one thread allocating (socket reader) and another releasing
+// (socket sender) settles into moving half a cache at a time instead of calling the allocator for every packet.
+template <size_t BLOCK_SIZE, size_t CACHE_SIZE = 64, size_t MAX_SHARED = 8192> class BufferPool {
+  public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t SIZE = BLOCK_SIZE;
+
+    static_assert(BLOCK_SIZE % ALIGNMENT == 0, "block size must be a multiple of the alignment");
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t in_use;
+        uint64_t high_water;
+    };
+
+    static void *allocate() {
+        LocalCache &cache = local_cache;
+        if (cache.buffers.empty()) {
+            refill(cache);
+        }
+
+        void *buffer;
+        if (!cache.buffers.empty()) {
+            buffer = cache.buffers.back();
+            cache.buffers.pop_back();
+            counters.hits.fetch_add(1, std::memory_order::relaxed);
+        } else {
+            buffer = std::aligned_alloc(ALIGNMENT, BLOCK_SIZE);
+            counters.misses.fetch_add(1, std::memory_order::relaxed);
+        }
+
+        const uint64_t in_use = counters.in_use.fetch_add(1, std::memory_order::relaxed) + 1;
+        uint64_t high_water = counters.high_water.load(std::memory_order::relaxed);
+        while (in_use > high_water && !counters.high_water.compare_exchange_weak(high_water, in_use, std::memory_order::relaxed)) {
+        }
+
+        return buffer;
+    }
+
+    static void release(void *buffer) {
+        LocalCache &cache = local_cache;
+        cache.buffers.push_back(buffer);
+        counters.in_use.fetch_sub(1, std::memory_order::relaxed);
+        if (cache.buffers.size() >= 2 * CACHE_SIZE) {
+            spill(cache, CACHE_SIZE);
+        }
+    }
+
+    // allocate and touch buffers ahead of time, at most MAX_SHARED of them wait in the shared list
+    static void prefault(size_t count) {
+        std::vector<void *> buffers(std::min(count, MAX_SHARED));
+        for (void *&buffer : buffers) {
+            buffer = std::aligned_alloc(ALIGNMENT, BLOCK_SIZE);
+            std::memset(buffer, 0, BLOCK_SIZE);
+        }
+
+        shared.lock.lock();
+        const size_t kept = std::min(buffers.size(), MAX_SHARED - std::min(MAX_SHARED, shared.buffers.size()));
+        shared.buffers.insert(shared.buffers.end(), buffers.begin(), buffers.begin() + kept);
+        shared.lock.unlock();
+
+        for (auto it = buffers.begin() + kept; it != buffers.end(); ++it) {
+            std::free(*it);
+        }
+    }
+
+    static Stats stats() {
+        return {
+            counters.hits.load(std::memory_order::relaxed),
+            counters.misses.load(std::memory_order::relaxed),
+            counters.in_use.load(std::memory_order::relaxed),
+            counters.high_water.load(std::memory_order::relaxed),
+        };
+    }
+
+  private:
+    struct LocalCache {
+        std::vector<void *> buffers;
+
+        LocalCache() { buffers.reserve(2 * CACHE_SIZE); }
+
+        // give everything back so buffers cached by an exiting thread can be reused by the others
+        ~LocalCache() { spill(*this, buffers.size()); }
+    };
+
+    struct SharedList {
+        HybridLock lock{"buffer pool " + std::to_string(BLOCK_SIZE)};
+        std::vector<void *> buffers;
+
+        ~SharedList() {
+            for (void *buffer : buffers) {
+                std::free(buffer);
+            }
+        }
+    };
+
+    struct Counters {
+        alignas(64) std::atomic<uint64_t> hits = 0;
+        alignas(64) std::atomic<uint64_t> misses = 0;
+        alignas(64) std::atomic<uint64_t> in_use = 0;
+        alignas(64) std::atomic<uint64_t> high_water = 0;
+    };
+
+    static void refill(LocalCache &cache) {
+        shared.lock.lock();
+        const size_t count = std::min(CACHE_SIZE, shared.buffers.size());
+        cache.buffers.insert(cache.buffers.end(), shared.buffers.end() - count, shared.buffers.end());
+        shared.buffers.resize(shared.buffers.size() - count);
+        shared.lock.unlock();
+    }
+
+    static void spill(LocalCache &cache, size_t count) {
+        const auto first = cache.buffers.end() - count;
+        shared.lock.lock();
+        const size_t kept = std::min(count, MAX_SHARED - std::min(MAX_SHARED, shared.buffers.size()));
+        shared.buffers.insert(shared.buffers.end(), first, first + kept);
+        shared.lock.unlock();
+
+        // shared list is full, the burst that needed these buffers is over
+        for (auto it = first + kept; it != cache.buffers.end(); ++it) {
+            std::free(*it);
+        }
+        cache.buffers.erase(first, cache.buffers.end());
+    }
+
+    static inline SharedList shared;
+    static inline Counters counters;
+    static inline thread_local LocalCache local_cache;
+};
+
+#endif // SCREAM_BUFFERPOOL_H
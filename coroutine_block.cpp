@@ -0,0 +1,40 @@
+#include "coroutine_block.h"
+#include "logger.h"
+
+void CoroutineBlock::start() {
+    if (!initialized) {
+        logger::log(logger::INFO, name, ": you need to init me first");
+        return;
+    }
+
+    if (!stop_condition.load()) {
+        logger::log(logger::INFO, name, ": task(s) already started");
+        return;
+    }
+
+    Scheduler *target = scheduler;
+    if (!target) {
+        own_scheduler = std::make_unique<Scheduler>(name);
+        own_scheduler->start(thread_config);
+        target = own_scheduler.get();
+    }
+
+    stop_condition.store(false);
+    group.stopped.store(false);
+    for (Task &task : tasks()) {
+        target->spawn(std::move(task), group);
+    }
+}
+
+void CoroutineBlock::stop() {
+    if (stop_condition.load()) {
+        logger::log(logger::INFO, name, ": task(s) already stopped");
+        return;
+    }
+
+    stop_condition.store(true);
+    Scheduler *target = scheduler ? scheduler : own_scheduler.get();
+    target->stop(group);
+    Scheduler::wait(group);
+    own_scheduler.reset();
+}
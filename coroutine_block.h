@@ -0,0 +1,37 @@
+#ifndef SCREAM_COROUTINEBLOCK_H
+#define SCREAM_COROUTINEBLOCK_H
+
+#include <memory>
+#include <vector>
+
+#include "scheduler.h"
+#include "simple_block.h"
+
+// Block made of tasks instead of threads: start() spawns them on the attached Scheduler, or on one of its own when
+// none is attached (the thread parameters of the block then apply to it), and stop() waits until they are all done.
+// Blocks move to it one at a time, the others keep their threads.
+class CoroutineBlock : public SimpleBlock {
+  public:
+    explicit CoroutineBlock(std::string name) : SimpleBlock(std::move(name)) {}
+    ~CoroutineBlock() override = default;
+
+    // before start(), nullptr for a scheduler of its own
+    void attach(Scheduler *scheduler) { this->scheduler = scheduler; }
+
+    void start() override;
+    void stop() override;
+
+  protected:
+    // the tasks making the block, each returns once its waits give false
+    virtual std::vector<Task> tasks() = 0;
+
+  private:
+    // threads are the scheduler's
+    void run() override {}
+
+    Scheduler *scheduler = nullptr;
+    std::unique_ptr<Scheduler> own_scheduler;
+    Task::Group group;
+};
+
+#endif // SCREAM_COROUTINEBLOCK_H
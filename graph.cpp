@@ -0,0 +1,492 @@
+extern "C" {
+#include <sched.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <fstream>
+#include <unordered_set>
+
+#include "graph.h"
+#include "logger.h"
+
+namespace {
+constexpr std::array LATENCY_NAMES = {"realtime", "low", "best_effort"};
+
+template <typename... Args> void error(const std::string &path, size_t line, Args &&...args) {
+    logger::log(logger::ERROR, "graph: ", path, ":", line, ": ", std::forward<Args>(args)...);
+}
+
+std::string trim(std::string_view text) {
+    const size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return std::string(text.substr(first, text.find_last_not_of(" \t\r") + 1 - first));
+}
+
+// every ${name} replaced by its variable, unknown is set to the first name without one
+bool substitute(std::string &text, const std::unordered_map<std::string, std::string> &variables, std::string &unknown) {
+    for (size_t first = text.find("${"); first != std::string::npos; first = text.find("${", first)) {
+        const size_t last = text.find('}', first);
+        if (last == std::string::npos) {
+            unknown = text.substr(first);
+            return false;
+        }
+
+        const auto it = variables.find(text.substr(first + 2, last - first - 2));
+        if (it == variables.end()) {
+            unknown = text.substr(first + 2, last - first - 2);
+            return false;
+        }
+        text.replace(first, last + 1 - first, it->second);
+        first += it->second.size();
+    }
+    return true;
+}
+
+template <typename T> bool parseNumber(const std::string &text, T &value) {
+    const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && ptr == text.data() + text.size();
+}
+} // namespace
+
+Graph::~Graph() {
+    if (running) {
+        stop();
+    }
+}
+
+bool Graph::load(const std::string &path, const std::unordered_map<std::string, std::string> &variables, Graph *shared) {
+    if (shared) {
+        classes = shared->classes;
+        owns_classes = false;
+    }
+    if (!parse(path, variables, shared ? BLOCKS : CLASSES | BLOCKS)) {
+        return false;
+    }
+
+    if (owns_classes) {
+        place();
+    }
+    return build(path);
+}
+
+bool Graph::loadClasses(const std::string &path) {
+    if (!parse(path, {}, CLASSES)) {
+        return false;
+    }
+
+    place();
+    return true;
+}
+
+void Graph::start() {
+    if (running) {
+        logger::log(logger::INFO, "graph: already started");
+        return;
+    }
+
+    if (owns_classes) {
+        for (const auto &latency_class : classes) {
+            if (latency_class->scheduler) {
+                latency_class->scheduler->start(latency_class->config);
+            }
+            if (latency_class->reactor) {
+                latency_class->reactor->start(latency_class->config);
+            }
+            latency_class->running = true;
+        }
+    }
+
+    for (const auto &node : nodes) {
+        if (node->block && node->started) {
+            node->block->start();
+        }
+    }
+    running = true;
+}
+
+void Graph::stop() {
+    if (!running) {
+        logger::log(logger::INFO, "graph: already stopped");
+        return;
+    }
+
+    for (auto node = nodes.rbegin(); node != nodes.rend(); ++node) {
+        if ((*node)->block && (*node)->started) {
+            (*node)->block->stop();
+        }
+    }
+
+    // nothing feeds the queues anymore, the threads that outlive the blocks let them go
+    for (const auto &node : nodes) {
+        const LatencyClass *latency_class = findClass(node->latency_class);
+        if (!latency_class || !node->sink) {
+            continue;
+        }
+        if (node->coroutine && latency_class->scheduler) {
+            latency_class->scheduler->release(node->sink->getQueue());
+        }
+        if (node->socket && latency_class->reactor) {
+            latency_class->reactor->release(node->sink->getQueue());
+        }
+    }
+
+    if (owns_classes) {
+        for (auto latency_class = classes.rbegin(); latency_class != classes.rend(); ++latency_class) {
+            if ((*latency_class)->reactor) {
+                (*latency_class)->reactor->stop();
+            }
+            if ((*latency_class)->scheduler) {
+                (*latency_class)->scheduler->stop();
+            }
+            (*latency_class)->running = false;
+        }
+    }
+    running = false;
+}
+
+Graph::Node *Graph::find(const std::string &name) {
+    const auto it = std::find_if(nodes.begin(), nodes.end(), [&name](const auto &node) { return node->name == name; });
+    return it == nodes.end() ? nullptr : it->get();
+}
+
+Graph::LatencyClass *Graph::findClass(const std::string &name) {
+    const auto it = std::find_if(classes.begin(), classes.end(), [&name](const auto &latency_class) { return latency_class->name == name; });
+    return it == classes.end() ? nullptr : it->get();
+}
+
+bool Graph::parse(const std::string &path, const std::unordered_map<std::string, std::string> &variables, int sections) {
+    std::ifstream file(path);
+    if (!file) {
+        logger::log(logger::ERROR, "graph: fail to open ", path);
+        return false;
+    }
+
+    enum {
+        NONE,
+        BLOCK,
+        CLASS,
+        EDGES,
+    } section = NONE;
+    Node *node = nullptr;
+    LatencyClass *latency_class = nullptr;
+    bool valid = true;
+    bool skipped = false;
+    std::string text;
+    for (size_t line = 1; std::getline(file, text); ++line) {
+        text = trim(text);
+        if (text.empty() || text.front() == '#') {
+            continue;
+        }
+
+        // variables are only looked for in the sections parsed
+        if (text.front() == '[') {
+            skipped = !(sections & (text.starts_with("[class ") ? CLASSES : BLOCKS));
+        }
+        if (skipped) {
+            continue;
+        }
+
+        if (std::string unknown; !substitute(text, variables, unknown)) {
+            error(path, line, "unknown variable ", unknown);
+            valid = false;
+            continue;
+        }
+
+        if (text.front() == '[') {
+            const std::string header = trim(std::string_view(text).substr(1, text.size() - 1 - (text.back() == ']')));
+            if (text.back() != ']') {
+                error(path, line, "missing ] after section ", header);
+                valid = false;
+                section = NONE;
+            } else if (header == "edges") {
+                section = EDGES;
+            } else if (header.starts_with("block ") && !find(prefix + trim(header.substr(6)))) {
+                nodes.push_back(std::make_unique<Node>());
+                node = nodes.back().get();
+                node->name = prefix + trim(header.substr(6));
+                node->line = line;
+                section = BLOCK;
+            } else if (header.starts_with("class ") && !findClass(trim(header.substr(6)))) {
+                classes.push_back(std::make_shared<LatencyClass>());
+                latency_class = classes.back().get();
+                latency_class->name = trim(header.substr(6));
+                section = CLASS;
+            } else {
+                error(path, line, "unknown or duplicate section ", header);
+                valid = false;
+                section = NONE;
+            }
+            continue;
+        }
+
+        if (section == EDGES) {
+            valid &= parseEdge(path, line, text);
+            continue;
+        }
+
+        const size_t equal = text.find('=');
+        if (section == NONE || equal == std::string::npos) {
+            error(path, line, section == NONE ? "outside of any section" : "expected key = value");
+            valid = false;
+            continue;
+        }
+
+        const std::string key = trim(std::string_view(text).substr(0, equal));
+        const std::string val = trim(std::string_view(text).substr(equal + 1));
+        if (section == BLOCK) {
+            if (key == "block_type") {
+                node->type = val;
+            } else if (key == "class") {
+                node->latency_class = val;
+            } else {
+                node->params[key] = val;
+            }
+            continue;
+        }
+
+        bool known = true;
+        bool valid_value = true;
+        try {
+            if (key == "latency") {
+                const auto latency = std::find(LATENCY_NAMES.begin(), LATENCY_NAMES.end(), val);
+                valid_value = latency != LATENCY_NAMES.end();
+                latency_class->latency = valid_value ? static_cast<Latency>(latency - LATENCY_NAMES.begin()) : BEST_EFFORT;
+            } else if (key == "cores") {
+                valid_value = parseNumber(val, latency_class->cores) && latency_class->cores >= 0;
+            } else if (key == "io_threads") {
+                valid_value = parseNumber(val, latency_class->io_threads);
+            } else if (ThreadConfig config; key == "cpus") {
+                config.set("cpu_affinity", val, valid_value);
+                latency_class->cpus = val;
+            } else if (config.set(key, val, valid_value)) {
+                latency_class->params[key] = val;
+            } else {
+                known = false;
+            }
+        } catch (const std::exception &) {
+            valid_value = false;
+        }
+
+        if (!known || !valid_value) {
+            error(path, line, known ? "invalid " : "unknown class key ", key, known ? " " + val : "");
+            valid = false;
+        }
+    }
+
+    return valid;
+}
+
+bool Graph::parseEdge(const std::string &path, size_t line, const std::string &text) {
+    const size_t arrow = text.find("->");
+    const size_t colon = text.rfind(':');
+    if (arrow == std::string::npos || colon == std::string::npos || colon < arrow) {
+        error(path, line, "expected from -> to : TYPE [control|interactive|media|inline]");
+        return false;
+    }
+
+    Edge edge = {};
+    edge.from = prefix + trim(std::string_view(text).substr(0, arrow));
+    edge.to = prefix + trim(std::string_view(text).substr(arrow + 2, colon - arrow - 2));
+    edge.line = line;
+    const std::string delivery = trim(std::string_view(text).substr(colon + 1));
+    const size_t space = delivery.find(' ');
+    const std::string type = delivery.substr(0, space);
+    const std::string option = space == std::string::npos ? std::string() : trim(std::string_view(delivery).substr(space + 1));
+
+    if (!MsgQueue::parseType(type, edge.type)) {
+        error(path, line, "unknown message type ", type);
+        return false;
+    }
+    if (option == "inline") {
+        edge.inline_call = true;
+    } else if (!option.empty()) {
+        edge.has_lane = MsgQueue::parseLane(option, edge.lane);
+        if (!edge.has_lane) {
+            error(path, line, "unknown lane ", option);
+            return false;
+        }
+    }
+
+    edges.push_back(std::move(edge));
+    return true;
+}
+
+void Graph::place() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        logger::log(logger::WARNING, "graph: fail to get the cpus of the process, classes are not placed");
+        return;
+    }
+
+    std::vector<int> available;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            available.push_back(cpu);
+        }
+    }
+    // highest first
+    std::vector<int> left(available.rbegin(), available.rend());
+    size_t reused = 0;
+
+    const auto take = [&](LatencyClass &latency_class, size_t count) {
+        std::vector<int> cpus;
+        bool shared = false;
+        for (size_t i = 0; i < count; ++i) {
+            if (left.empty()) {
+                // once they are all given, the same order again
+                cpus.push_back(available[available.size() - 1 - reused++ % available.size()]);
+                shared = true;
+            } else {
+                cpus.push_back(left.front());
+                left.erase(left.begin());
+            }
+        }
+        if (shared) {
+            logger::log(logger::WARNING, "graph: not enough cpus left, class ", latency_class.name, " shares some");
+        }
+        return cpus;
+    };
+
+    std::vector<std::vector<int>> placement(classes.size());
+    for (const Latency latency : {REALTIME, LOW, BEST_EFFORT}) {
+        for (size_t i = 0; i < classes.size(); ++i) {
+            LatencyClass &latency_class = *classes[i];
+            if (latency_class.latency != latency) {
+                continue;
+            }
+
+            if (!latency_class.cpus.empty()) {
+                ThreadConfig config;
+                bool valid;
+                config.set("cpu_affinity", latency_class.cpus, valid);
+                placement[i] = config.cpus;
+                for (const int cpu : config.cpus) {
+                    std::erase(left, cpu);
+                }
+            } else if (latency_class.cores > 0 || (latency_class.cores < 0 && latency != BEST_EFFORT)) {
+                placement[i] = take(latency_class, latency_class.cores < 0 ? 1 : static_cast<size_t>(latency_class.cores));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < classes.size(); ++i) {
+        LatencyClass &latency_class = *classes[i];
+        // the best effort classes without cores of their own share what is left, or the whole host when nothing is
+        if (latency_class.latency == BEST_EFFORT && latency_class.cpus.empty() && latency_class.cores <= 0) {
+            placement[i] = left;
+        }
+
+        if (latency_class.latency == REALTIME) {
+            latency_class.params.try_emplace("sched_policy", "fifo");
+            latency_class.params.try_emplace("sched_priority", "50");
+        } else if (latency_class.latency == LOW) {
+            latency_class.params.try_emplace("timer_slack", "1");
+        }
+
+        std::string cpus;
+        for (const int cpu : placement[i]) {
+            cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        if (!cpus.empty()) {
+            latency_class.params["cpu_affinity"] = cpus;
+        }
+
+        for (const auto &[key, val] : latency_class.params) {
+            bool valid;
+            latency_class.config.set(key, val, valid);
+        }
+        logger::log(logger::INFO, "graph: class ", latency_class.name, " (", LATENCY_NAMES[latency_class.latency], ") on cpus ",
+                    cpus.empty() ? "any" : cpus);
+    }
+}
+
+bool Graph::build(const std::string &path) {
+    bool valid = true;
+    for (const auto &node : nodes) {
+        const auto factory = factories.find(node->type);
+        if (factory == factories.end()) {
+            error(path, node->line, node->name, ": unknown block_type \"", node->type, "\"");
+            valid = false;
+            continue;
+        }
+
+        LatencyClass *latency_class = nullptr;
+        if (!node->latency_class.empty()) {
+            latency_class = findClass(node->latency_class);
+            if (!latency_class) {
+                error(path, node->line, node->name, ": unknown class ", node->latency_class);
+                valid = false;
+                continue;
+            }
+            // the block's own parameters win
+            for (const auto &[key, val] : latency_class->params) {
+                node->params.try_emplace(key, val);
+            }
+        }
+
+        factory->second(*node);
+        if (node->block) {
+            node->block->init(node->params);
+        } else if (!node->params.empty()) {
+            logger::log(logger::WARNING, "graph: ", node->name, " takes no parameters");
+        }
+
+        if (latency_class && node->coroutine) {
+            if (!latency_class->scheduler) {
+                latency_class->scheduler = std::make_unique<Scheduler>(latency_class->name + " tasks");
+                if (latency_class->running) {
+                    latency_class->scheduler->start(latency_class->config);
+                }
+            }
+            node->coroutine->attach(latency_class->scheduler.get());
+        }
+        if (latency_class && node->socket && latency_class->io_threads > 0) {
+            if (!latency_class->reactor) {
+                latency_class->reactor = std::make_unique<Reactor>(latency_class->name + " io", latency_class->io_threads);
+                if (latency_class->running) {
+                    latency_class->reactor->start(latency_class->config);
+                }
+            }
+            node->socket->attach(latency_class->reactor.get());
+        }
+    }
+
+    std::unordered_set<const Node *> queued;
+    std::unordered_set<const Node *> inlined;
+    for (const Edge &edge : edges) {
+        Node *from = find(edge.from);
+        Node *to = find(edge.to);
+        if (!from || !to) {
+            error(path, edge.line, "unknown block ", from ? edge.to : edge.from);
+            valid = false;
+        } else if (!from->source) {
+            error(path, edge.line, edge.from, " forwards no messages");
+            valid = false;
+        } else if (edge.inline_call) {
+            if (!to->handler) {
+                error(path, edge.line, edge.to, " cannot run inline");
+                valid = false;
+                continue;
+            }
+            from->source->registerHandler(edge.type, to->handler);
+            inlined.insert(to);
+        } else if (!to->sink) {
+            error(path, edge.line, edge.to, " has no queue, only inline edges can reach it");
+            valid = false;
+        } else {
+            edge.has_lane ? from->source->registerQueue(edge.type, to->sink->getQueue(), edge.lane)
+                          : from->source->registerQueue(edge.type, to->sink->getQueue());
+            queued.insert(to);
+        }
+    }
+
+    for (const auto &node : nodes) {
+        node->started = !inlined.contains(node.get()) || queued.contains(node.get());
+    }
+    return valid;
+}
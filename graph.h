@@ -0,0 +1,190 @@
+#ifndef SCREAM_GRAPH_H
+#define SCREAM_GRAPH_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "coroutine_block.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "simple_block.h"
+#include "sink.h"
+#include "source.h"
+#include "udp_socket.h"
+
+// Blocks and the edges between them read from a config file rather than wired in main(), so that the topology can be
+// tuned per deployment without a rebuild, e.g.
+//     # the video path, kept on one core
+//     [class video]
+//     latency = low
+//     cores = 1
+//     io_threads = 1
+//
+//     [block scream server]
+//     block_type = scream_v2_server_l4s
+//     class = video
+//     local_port = 30002
+//     remote_addr = ${proxy_client_ip}
+//
+//     [edges]
+//     server side video rtp -> video rtp converter : RAW inline
+//     video rtp converter -> scream server : RTP_PACKET
+//
+// A block section gives the registered type of the block (block_type), its latency class if any (class), and the init()
+// parameters of the block. An edge subscribes the queue of the destination to a message type of the source, on the
+// lane of the type or the one given (control, interactive or media); "inline" registers the destination as a
+// MsgHandler instead, so that it runs in the thread of the source. ${name} is replaced by the variable of that name
+// given to load().
+//
+// A class section places its blocks: "latency" is realtime, low or best_effort, "cores" the number of cpus it gets
+// (1 by default, 0 for best_effort, which then shares what the others left) or "cpus" an explicit list (see
+// ThreadConfig), "io_threads" the number of I/O threads its udp sockets share through a Reactor (0 to keep theirs), and
+// any ThreadConfig key applies to all its threads. The cpus the process may run on are dealt out from the highest,
+// away from the interrupts usually served by cpu 0, realtime classes first, then low; realtime runs SCHED_FIFO 50 and
+// low with a timer slack of 1 ns unless told otherwise. The coroutine blocks of a class share one Scheduler.
+//
+// Several graphs can share the classes of another one, and so its cpus and threads, e.g. the sessions of a
+// SessionManager; the graphs sharing classes are then loaded, started and stopped from one thread at a time.
+class Graph {
+  public:
+    struct Node {
+        std::string name;
+        std::string type;
+        std::string latency_class;
+        std::unordered_map<std::string, std::string> params;
+        // what the factory made, the views below point into it
+        std::shared_ptr<void> object;
+        SimpleBlock *block = nullptr;
+        CoroutineBlock *coroutine = nullptr;
+        UdpSocket *socket = nullptr;
+        Source *source = nullptr;
+        Sink *sink = nullptr;
+        MsgHandler *handler = nullptr;
+        // false when it is only reached by inline edges, its thread would have nothing to do
+        bool started = true;
+        // of its section, for the errors found once the whole file is read
+        size_t line = 0;
+
+        template <typename T> void hold(std::shared_ptr<T> object) {
+            if constexpr (std::is_base_of_v<SimpleBlock, T>) {
+                block = object.get();
+            }
+            if constexpr (std::is_base_of_v<CoroutineBlock, T>) {
+                coroutine = object.get();
+            }
+            if constexpr (std::is_base_of_v<UdpSocket, T>) {
+                socket = object.get();
+            }
+            if constexpr (std::is_base_of_v<Source, T>) {
+                source = object.get();
+            }
+            if constexpr (std::is_base_of_v<Sink, T>) {
+                sink = object.get();
+            }
+            if constexpr (std::is_base_of_v<MsgHandler, T>) {
+                handler = object.get();
+            }
+            this->object = std::move(object);
+        }
+    };
+
+    // makes the object of the node, given its name, and hands it to Node::hold()
+    using Factory = std::function<void(Node &node)>;
+
+    // the prefix is prepended to the block names, also in the edges, e.g. to tell sessions apart in the logs
+    explicit Graph(std::string prefix = {}) : prefix(std::move(prefix)) {}
+    ~Graph();
+
+    Graph(const Graph &) = delete;
+    Graph &operator=(const Graph &) = delete;
+
+    // blocks are built from their name, other types such as a Pipeline with their default constructor
+    template <typename T> void registerType(const std::string &type) {
+        registerType(type, [](Node &node) {
+            if constexpr (std::is_constructible_v<T, std::string>) {
+                node.hold(std::make_shared<T>(node.name));
+            } else {
+                node.hold(std::make_shared<T>());
+            }
+        });
+    }
+
+    void registerType(const std::string &type, Factory factory) { factories[type] = std::move(factory); }
+
+    // parse the file, place the classes, build, init and wire the blocks; errors are logged with their line. With
+    // shared, the blocks run on the classes and threads of that graph, which must outlive this one, and the class
+    // sections of the file are skipped
+    bool load(const std::string &path, const std::unordered_map<std::string, std::string> &variables, Graph *shared = nullptr);
+
+    // only the class sections of the file, placed, for other graphs to share
+    bool loadClasses(const std::string &path);
+
+    // the threads of the classes unless they are shared from another graph, then the blocks in file order
+    void start();
+    // the other way round, the queues of the blocks are released from the shared threads
+    void stop();
+
+    // by its full name, prefix included
+    Node *find(const std::string &name);
+
+  private:
+    enum Latency {
+        REALTIME,
+        LOW,
+        BEST_EFFORT,
+    };
+
+    struct LatencyClass {
+        std::string name;
+        Latency latency = BEST_EFFORT;
+        // -1 when not given
+        int cores = -1;
+        std::string cpus;
+        size_t io_threads = 0;
+        // ThreadConfig keys, cpu_affinity included once placed
+        std::unordered_map<std::string, std::string> params;
+        ThreadConfig config;
+        std::unique_ptr<Scheduler> scheduler;
+        std::unique_ptr<Reactor> reactor;
+        // threads made after the graph owning the class started are started right away
+        bool running = false;
+    };
+
+    struct Edge {
+        std::string from;
+        std::string to;
+        Msg::MsgType type;
+        // queue lane, the type's own when not given
+        bool has_lane = false;
+        MsgQueue::Lane lane = MsgQueue::MEDIA;
+        bool inline_call = false;
+        size_t line;
+    };
+
+    // class sections, the others, or both
+    enum Sections {
+        CLASSES = 1,
+        BLOCKS = 2,
+    };
+
+    bool parse(const std::string &path, const std::unordered_map<std::string, std::string> &variables, int sections);
+    bool parseEdge(const std::string &path, size_t line, const std::string &text);
+    void place();
+    bool build(const std::string &path);
+    LatencyClass *findClass(const std::string &name);
+
+    std::string prefix;
+    std::unordered_map<std::string, Factory> factories;
+    // shared threads go away after the blocks using them
+    std::vector<std::shared_ptr<LatencyClass>> classes;
+    bool owns_classes = true;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<Edge> edges;
+    bool running = false;
+};
+
+#endif // SCREAM_GRAPH_H
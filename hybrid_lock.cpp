@@ -0,0 +1,90 @@
+extern "C" {
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <mutex>
+
+#include "hybrid_lock.h"
+
+namespace {
+struct Registry {
+    std::mutex mutex;
+    std::vector<const HybridLock *> locks;
+};
+
+// constructed by the first named lock, so it outlives the static ones, e.g. the logger's
+Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+} // namespace
+
+HybridLock::HybridLock(std::string name) : name(std::move(name)) {
+    if (!this->name.empty()) {
+        Registry &locks = registry();
+        std::lock_guard guard(locks.mutex);
+        locks.locks.push_back(this);
+    }
+}
+
+HybridLock::~HybridLock() {
+    if (!name.empty()) {
+        Registry &locks = registry();
+        std::lock_guard guard(locks.mutex);
+        std::erase(locks.locks, this);
+    }
+}
+
+void HybridLock::lockContended() noexcept {
+    const auto start = std::chrono::steady_clock::now();
+    bool acquired = false;
+    for (uint32_t i = 0; i < SPIN_COUNT && !acquired; ++i) {
+        __builtin_ia32_pause();
+        uint32_t expected = UNLOCKED;
+        acquired = state.load(std::memory_order::relaxed) == UNLOCKED &&
+                   state.compare_exchange_weak(expected, LOCKED, std::memory_order::acquire, std::memory_order::relaxed);
+    }
+
+    // from now on the holder knows it has someone to wake up, and so does this thread once it gets the lock, as it
+    // cannot tell whether others sleep too
+    bool slept = false;
+    while (!acquired && state.exchange(PARKED, std::memory_order::acquire) != UNLOCKED) {
+        slept = true;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAIT_PRIVATE, PARKED, nullptr, nullptr, 0);
+    }
+
+    // the lock is held, nobody else writes the counters
+    const auto waited = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    contended.store(contended.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+    parked.store(parked.load(std::memory_order::relaxed) + slept, std::memory_order::relaxed);
+    wait_ns.store(wait_ns.load(std::memory_order::relaxed) + waited, std::memory_order::relaxed);
+    max_wait_ns.store(std::max(max_wait_ns.load(std::memory_order::relaxed), waited), std::memory_order::relaxed);
+}
+
+void HybridLock::wake() noexcept { syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0); }
+
+HybridLock::Stats HybridLock::getStats() const {
+    return {
+        name,
+        acquisitions.load(std::memory_order::relaxed),
+        contended.load(std::memory_order::relaxed),
+        parked.load(std::memory_order::relaxed),
+        wait_ns.load(std::memory_order::relaxed),
+        max_wait_ns.load(std::memory_order::relaxed),
+        hold_ns.load(std::memory_order::relaxed),
+    };
+}
+
+std::vector<HybridLock::Stats> HybridLock::stats() {
+    Registry &locks = registry();
+    std::lock_guard guard(locks.mutex);
+    std::vector<Stats> stats;
+    stats.reserve(locks.locks.size());
+    for (const HybridLock *lock : locks.locks) {
+        stats.push_back(lock->getStats());
+    }
+    return stats;
+}
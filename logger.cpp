@@ -4,7 +4,7 @@
 #include "logger.h"
 
 namespace logger {
-spinlock lock;
+HybridLock lock("logger");
 std::ofstream file;
 bool is_tee = true;
 Level level = INFO;
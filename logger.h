@@ -5,7 +5,7 @@
 #include <fstream>
 #include <iostream>
 
-#include "spinlock.h"
+#include "hybrid_lock.h"
 
 namespace logger {
 enum Level {
@@ -15,7 +15,7 @@ enum Level {
     ERROR,
 };
 
-extern spinlock lock;
+extern HybridLock lock;
 extern std::ofstream file;
 extern bool is_tee;
 extern Level level;
@@ -1,226 +1,173 @@
+extern "C" {
+#include <poll.h>
+#include <unistd.h>
+}
+
 #include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 
-#include "basic_rtp_generator.h"
+#include "graph.h"
 #include "logger.h"
-#include "msg_type_converter.h"
-#include "scream_server_single.h"
+#include "realtime.h"
 #include "scream_utils.h"
-#include "scream_v2_server_single.h"
-#include "tcp_client.h"
-#include "tcp_server.h"
-#include "udp_socket.h"
+#include "server_types.h"
+#include "session_manager.h"
+#include "stats.h"
 
 bool stop = false;
 
+// pool buffers faulted in at startup when running locked in memory
+constexpr size_t PREFAULT_PACKET_BUFFERS = 4096;
+constexpr size_t PREFAULT_SMALL_BUFFERS = 1024;
+
 void signalHandler(int signum) {
     logger::log(logger::INFO, "Interrupt signal (", signum, ") received");
     stop = true;
 }
 
+void logSession(SessionManager &sessions, uint32_t id) {
+    const auto variables = sessions.describe(id);
+    std::string text;
+    for (const std::string &port : server_types::SESSION_PORTS) {
+        text += ", " + port + "=" + variables.at(port);
+    }
+    logger::log(logger::INFO, "control: session ", id, " ssrc=", variables.at("ssrc"), ", game server=", variables.at("game_server_ip"), ':',
+                variables.at("game_server_port"), ", proxy client=", variables.at("proxy_client_ip"), text);
+}
+
+// one command per line: "open game_server_ip=<ip> proxy_client_ip=<ip> [game_server_port=<port>] [key=value...]",
+// "close <session>" or "list"
+void control(SessionManager &sessions, const std::string &line, const std::unordered_map<std::string, std::string> &defaults) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+    if (command == "open") {
+        auto variables = defaults;
+        for (std::string word; words >> word;) {
+            const size_t equal = word.find('=');
+            if (equal == std::string::npos) {
+                logger::log(logger::WARNING, "control: expected key=value instead of ", word);
+                return;
+            }
+            variables[word.substr(0, equal)] = word.substr(equal + 1);
+        }
+        if (!variables.contains("game_server_ip") || !variables.contains("proxy_client_ip")) {
+            logger::log(logger::WARNING, "control: open needs game_server_ip and proxy_client_ip");
+        } else if (const uint32_t id = sessions.open(variables); id != 0) {
+            logSession(sessions, id);
+        }
+    } else if (uint32_t id; command == "close") {
+        if (words >> id) {
+            sessions.close(id);
+        } else {
+            logger::log(logger::WARNING, "control: close needs a session id");
+        }
+    } else if (command == "list") {
+        for (const uint32_t session : sessions.list()) {
+            logSession(sessions, session);
+        }
+    } else if (!command.empty()) {
+        logger::log(logger::WARNING, "control: unknown command ", command);
+    }
+}
+
+int runSession(int argc, char *argv[]) {
+    // substituted in the graph file
+    const std::unordered_map<std::string, std::string> variables = {
+        {"game_server_ip", argv[1]},
+        {"proxy_client_ip", argv[2]},
+        {"game_server_binding_ip", argc >= 4 ? argv[3] : "127.0.0.1"},
+        {"proxy_client_binding_ip", argc >= 5 ? argv[4] : "0.0.0.0"},
+    };
+    const std::string graph_path(argc >= 6 ? argv[5] : "server.graph");
+
+    Graph graph;
+    server_types::registerTypes(graph);
+    if (!graph.load(graph_path, variables)) {
+        return 1;
+    }
+
+    graph.start();
+    for (uint32_t elapsed = 1; !stop; ++elapsed) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (elapsed % 10 == 0) {
+            stats::log();
+        }
+    }
+    graph.stop();
+    return 0;
+}
+
+int runSessions(int argc, char *argv[]) {
+    const auto first_port = static_cast<uint16_t>(std::stoul(argv[2]));
+    const auto last_port = static_cast<uint16_t>(std::stoul(argv[3]));
+    const std::string graph_path(argc >= 5 ? argv[4] : "session.graph");
+    const std::unordered_map<std::string, std::string> defaults = {
+        {"game_server_port", "9999"},
+        {"game_server_binding_ip", "127.0.0.1"},
+        {"proxy_client_binding_ip", "0.0.0.0"},
+    };
+
+    SessionManager sessions(graph_path, server_types::SESSION_PORTS, first_port, last_port, server_types::registerTypes);
+    if (!sessions.start()) {
+        return 1;
+    }
+
+    // commands come on stdin, once it is closed the sessions open stay until the process is stopped
+    pollfd input = {.fd = STDIN_FILENO, .events = POLLIN, .revents = 0};
+    std::string pending;
+    auto last_report = std::chrono::steady_clock::now();
+    while (!stop) {
+        if (poll(&input, 1, 1000) > 0) {
+            char chunk[256];
+            const ssize_t size = read(STDIN_FILENO, chunk, sizeof(chunk));
+            if (size <= 0) {
+                input.fd = -1;
+            }
+            pending.append(chunk, std::max<ssize_t>(size, 0));
+            for (size_t end; (end = pending.find('\n')) != std::string::npos; pending.erase(0, end + 1)) {
+                control(sessions, pending.substr(0, end), defaults);
+            }
+        }
+
+        if (const auto now = std::chrono::steady_clock::now(); now - last_report >= std::chrono::seconds(10)) {
+            stats::log();
+            const auto usage = sessions.usage();
+            logger::log(logger::DEBUG, "sessions: count=", usage.sessions, ", cpu=", usage.cpu * 100, "%, per session=",
+                        usage.sessions > 0 ? usage.cpu * 100 / static_cast<double>(usage.sessions) : 0, "%");
+            last_report = now;
+        }
+    }
+    sessions.stop();
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
+    const bool multi_session = argc >= 2 && std::string_view(argv[1]) == "--sessions";
+    if (argc < (multi_session ? 4 : 3)) {
         std::cerr
             << "command format is: " << argv[0]
             << " <game_server_ip> <proxy_client_ip> [game_server_binding_ip (default = 127.0.0.1)] [proxy_client_binding_ip (default = 0.0.0.0)]"
+               " [graph (default = server.graph)]\n"
+            << "               or: " << argv[0]
+            << " --sessions <first_port> <last_port> [graph (default = session.graph)], then open, close and list commands on stdin"
             << std::endl;
         return 1;
     }
 
-    const std::string game_server_ip(argv[1]);
-    const std::string proxy_client_ip(argv[2]);
-    const std::string game_server_binding_ip(argc >= 4 ? argv[4] : "127.0.0.1");
-    const std::string proxy_client_binding_ip(argc >= 5 ? argv[5] : "0.0.0.0");
-
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     logger::setMinimalLogLevel(logger::DEBUG);
 
-    /*------------------------------------------------------------------------------------------------------------------
-     * video chain
-    ------------------------------------------------------------------------------------------------------------------*/
-    BasicRtpGenerator generator("video encoder");
-    /*generator.init({
-        {"type", "video"},
-        {"bitrate", "1000000"},
-        {"framerate", "30"},
-        {"ssrc", "100"},
-    });*/
-    UdpSocket server_side_video_rtp("server side video rtp");
-    server_side_video_rtp.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "10002"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "0"},
-    }); // server udp port is dynamic
-    MsgTypeConverter<Msg::RAW, Msg::RTP_PACKET> video_rtp_converter("video rtp message converter");
-    video_rtp_converter.init({});
-    ScreamV2ServerSingle scream("scream server", true);
-    scream.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "30002"},
-        {"remote_addr", proxy_client_ip},
-        {"remote_port", "30002"},
-        {"min_bitrate", "500000"},
-        {"max_bitrate", "30000000"},
-        {"start_bitrate", "10000000"},
-    });
-    // generator.registerQueue(Msg::RTP_PACKET, scream.getQueue());
-    // scream.registerQueue(Msg::BITRATE_REQUEST, generator.getQueue());
-    server_side_video_rtp.registerQueue(Msg::RAW, video_rtp_converter.getQueue());
-    video_rtp_converter.registerQueue(Msg::RTP_PACKET, scream.getQueue());
-
-    UdpSocket server_side_video_rtcp("server side video rtcp");
-    server_side_video_rtcp.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "10003"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "0"},
-    }); // server udp port is dynamic
-    UdpSocket client_side_video_rtcp("client side video rtcp");
-    client_side_video_rtcp.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "30003"},
-        {"remote_addr", proxy_client_ip},
-        {"remote_port", "30003"},
-    });
-    server_side_video_rtcp.registerQueue(Msg::RAW, client_side_video_rtcp.getQueue());
-    client_side_video_rtcp.registerQueue(Msg::RAW, server_side_video_rtcp.getQueue());
-
-    /*------------------------------------------------------------------------------------------------------------------
-     * audio chain
-    ------------------------------------------------------------------------------------------------------------------*/
-    UdpSocket server_side_audio_rtp("server side audio rtp");
-    server_side_audio_rtp.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "10000"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "0"},
-    }); // server udp port is dynamic
-    UdpSocket client_side_audio_rtp("client side audio rtp");
-    client_side_audio_rtp.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "30000"},
-        {"remote_addr", proxy_client_ip},
-        {"remote_port", "30000"},
-    });
-    server_side_audio_rtp.registerQueue(Msg::RAW, client_side_audio_rtp.getQueue());
-    client_side_audio_rtp.registerQueue(Msg::RAW, server_side_audio_rtp.getQueue());
-
-    UdpSocket server_side_audio_rtcp("server side audio rtcp");
-    server_side_audio_rtcp.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "10001"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "0"},
-    }); // server udp port is dynamic
-    UdpSocket client_side_audio_rtcp("client side audio rtcp");
-    client_side_audio_rtcp.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "30001"},
-        {"remote_addr", proxy_client_ip},
-        {"remote_port", "30001"},
-    });
-    server_side_audio_rtcp.registerQueue(Msg::RAW, client_side_audio_rtcp.getQueue());
-    client_side_audio_rtcp.registerQueue(Msg::RAW, server_side_audio_rtcp.getQueue());
-
-    /*------------------------------------------------------------------------------------------------------------------
-     * input chain
-    ------------------------------------------------------------------------------------------------------------------*/
-    UdpSocket server_side_input_stream("server side udp inputs");
-    server_side_input_stream.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "19999"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "9999"},
-    });
-    UdpSocket client_side_input_stream("client side udp inputs");
-    client_side_input_stream.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "29999"},
-        {"remote_addr", proxy_client_ip},
-        {"remote_port", "29999"},
-    });
-    server_side_input_stream.registerQueue(Msg::RAW, client_side_input_stream.getQueue());
-    client_side_input_stream.registerQueue(Msg::RAW, server_side_input_stream.getQueue());
-
-    /*------------------------------------------------------------------------------------------------------------------
-     * command chain
-    ------------------------------------------------------------------------------------------------------------------*/
-
-    TcpServer tcp_server("client side tcp commands");
-    tcp_server.init({
-        {"local_addr", proxy_client_binding_ip},
-        {"local_port", "29999"},
-    });
-    MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW> brm_converter("bitrate request message converter");
-    brm_converter.init({});
-    TcpClient tcp_client("server side tcp commands");
-    tcp_client.init({
-        {"local_addr", game_server_binding_ip},
-        {"local_port", "19999"},
-        {"remote_addr", game_server_ip},
-        {"remote_port", "9999"},
-    });
-
-    tcp_server.registerQueue(Msg::RAW, tcp_client.getQueue());
-    tcp_client.registerQueue(Msg::RAW, tcp_server.getQueue());
-    scream.registerQueue(Msg::BITRATE_REQUEST, brm_converter.getQueue());
-    brm_converter.registerQueue(Msg::RAW, tcp_client.getQueue());
-
-    /*------------------------------------------------------------------------------------------------------------------
-     * start all blocks
-    ------------------------------------------------------------------------------------------------------------------*/
-    initT0();
-    scream.start();
-    // generator.start();
-    video_rtp_converter.start();
-    server_side_video_rtp.start();
-
-    server_side_video_rtcp.start();
-    client_side_video_rtcp.start();
-
-    client_side_audio_rtp.start();
-    server_side_audio_rtp.start();
-
-    server_side_audio_rtcp.start();
-    client_side_audio_rtcp.start();
-
-    server_side_input_stream.start();
-    client_side_input_stream.start();
-
-    brm_converter.start();
-    tcp_client.start();
-    tcp_server.start();
-
-    while (!stop) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    // SCREAM_MLOCK=1 keeps the whole process in memory, blocks take their own cpu and scheduling parameters
+    if (const char *mlock = std::getenv("SCREAM_MLOCK"); mlock && std::string_view(mlock) == "1") {
+        realtime::lockMemory(PREFAULT_PACKET_BUFFERS, PREFAULT_SMALL_BUFFERS);
     }
 
-    /*------------------------------------------------------------------------------------------------------------------
-     * stop all blocks
-    ------------------------------------------------------------------------------------------------------------------*/
-    brm_converter.stop();
-    tcp_server.stop();
-    tcp_client.stop();
-
-    client_side_input_stream.stop();
-    server_side_input_stream.stop();
-
-    client_side_audio_rtcp.stop();
-    server_side_audio_rtcp.stop();
-
-    server_side_audio_rtp.stop();
-    client_side_audio_rtp.stop();
-
-    client_side_video_rtcp.stop();
-    server_side_video_rtcp.stop();
-
-    server_side_video_rtp.stop();
-    video_rtp_converter.stop();
-    // generator.stop();
-    scream.stop();
-
+    initT0();
+    const int result = multi_session ? runSessions(argc, argv) : runSession(argc, argv);
     logger::log(logger::INFO, "all done");
-    return 0;
+    return result;
 }
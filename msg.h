@@ -0,0 +1,277 @@
+#ifndef SCREAM_MSG_H
+#define SCREAM_MSG_H
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "buffer_pool.h"
+
+class MsgPtr;
+
+// Message header and payload live in the same block: the header takes the first cache line and the payload follows,
+// surrounded by some headroom and tailroom so that protocol headers or trailers can be added without a copy. Blocks
+// small enough come from the packet pool, so a full UDP datagram costs a single recycled buffer, and control messages
+// or short payloads come from a pool of small blocks.
+struct alignas(64) Msg {
+    enum MsgType {
+        NONE,
+        RAW,
+        RTP_PACKET,
+        RTCP_PACKET,
+        BITRATE_REQUEST,
+        IFRAME_REQUEST,
+    };
+
+    // number of message types, keep it in sync with the last one
+    static constexpr size_t TYPE_COUNT = IFRAME_REQUEST + 1;
+
+    static constexpr size_t HEADER_SIZE = 64;
+    static constexpr size_t DEFAULT_HEADROOM = 32;
+    static constexpr size_t DEFAULT_TAILROOM = 32;
+    static constexpr size_t BUFFER_SIZE = 1600;
+    // a full UDP datagram (UDP_BUFFER_SIZE = 1472) fits with the default headroom and tailroom
+    static constexpr size_t CAPACITY = BUFFER_SIZE - HEADER_SIZE - DEFAULT_HEADROOM - DEFAULT_TAILROOM;
+    using Pool = BufferPool<BUFFER_SIZE>;
+    static constexpr size_t SMALL_BUFFER_SIZE = 128;
+    using SmallPool = BufferPool<SMALL_BUFFER_SIZE>;
+
+    MsgType type = NONE;
+    void *data = nullptr;
+    ssize_t size = 0;
+    // timestamp for media, value carried by control messages (e.g. target bitrate in bps for BITRATE_REQUEST)
+    uint64_t extra = 0;
+
+    Msg(const Msg &) = delete;
+    Msg &operator=(const Msg &) = delete;
+
+    // new message owned by the returned handle, with room for capacity bytes of payload, a capacity of 0 gives a
+    // message without any payload buffer
+    static MsgPtr create(MsgType type, size_t capacity = 0, size_t headroom = DEFAULT_HEADROOM, size_t tailroom = DEFAULT_TAILROOM);
+
+    // same payload under another type, changed in place when the caller holds the only reference, otherwise a header
+    // only message sharing the payload of the original one
+    static MsgPtr retag(MsgPtr &&msg, MsgType type);
+
+    // the message itself when the caller holds the only reference to it and to its payload, otherwise a copy of it,
+    // so that the payload can be changed without touching what other holders see
+    static MsgPtr writable(MsgPtr &&msg);
+
+    // payload-less message carrying a scalar, taken from the small pool
+    static MsgPtr control(MsgType type, uint64_t value);
+
+    // packet pool block whose payload is filled before it becomes a message, e.g. by the kernel; the payload starts at
+    // packetPayload() and takes up to CAPACITY bytes, the default headroom and tailroom are left around it
+    static void *reservePacket() { return Pool::allocate(); }
+
+    static void *packetPayload(void *block) { return static_cast<uint8_t *>(block) + HEADER_SIZE + DEFAULT_HEADROOM; }
+
+    // the header is built in place, the payload is not touched
+    static MsgPtr fromPacket(void *block, MsgType type, size_t size);
+
+    // for a block that never became a message
+    static void releasePacket(void *block) { Pool::release(block); }
+
+    // free space around the payload, always 0 for a view as the payload belongs to another message
+    size_t headroom() const { return parent ? 0 : static_cast<uint8_t *>(data) - room(); }
+    size_t tailroom() const { return parent ? 0 : room() + room_size - (static_cast<uint8_t *>(data) + size); }
+
+    // grow or shrink the payload in place, only on a message the caller holds the single reference to and within the
+    // available headroom/tailroom; return the start of the added or remaining area
+    void *pushHeader(size_t len) {
+        assert(len <= headroom());
+        data = static_cast<uint8_t *>(data) - len;
+        size += static_cast<ssize_t>(len);
+        return data;
+    }
+
+    void *pullHeader(size_t len) {
+        data = static_cast<uint8_t *>(data) + len;
+        size -= static_cast<ssize_t>(len);
+        return data;
+    }
+
+    void *pushTrailer(size_t len) {
+        assert(len <= tailroom());
+        void *trailer = static_cast<uint8_t *>(data) + size;
+        size += static_cast<ssize_t>(len);
+        return trailer;
+    }
+
+    void pullTrailer(size_t len) { size -= static_cast<ssize_t>(len); }
+
+  private:
+    enum PoolType : uint8_t {
+        NO_POOL,
+        SMALL_POOL,
+        PACKET_POOL,
+    };
+
+    Msg() = default;
+    ~Msg() = default;
+
+    static void destroy(Msg *msg) noexcept;
+
+    uint8_t *room() const { return reinterpret_cast<uint8_t *>(const_cast<Msg *>(this)) + HEADER_SIZE; }
+
+    std::atomic<uint32_t> refcount = 1;
+    uint32_t room_size = 0;
+    PoolType pool = NO_POOL;
+    // message owning the payload when this one is a view
+    Msg *parent = nullptr;
+
+    friend class MsgPtr;
+};
+
+static_assert(sizeof(Msg) == Msg::HEADER_SIZE, "Msg header must fit in one cache line");
+
+// Intrusive reference counted handle on a Msg. Moving a handle never touches the counter, only copies do, so a
+// message going to a single queue travels from producer to consumer without any atomic operation. A message held by
+// several handles is shared and must be treated as read-only.
+class MsgPtr {
+  public:
+    MsgPtr() noexcept = default;
+
+    // adopt a reference previously given away by release()
+    explicit MsgPtr(Msg *msg) noexcept : msg(msg) {}
+
+    MsgPtr(const MsgPtr &other) noexcept : msg(other.msg) {
+        if (msg) {
+            msg->refcount.fetch_add(1, std::memory_order::relaxed);
+        }
+    }
+
+    MsgPtr(MsgPtr &&other) noexcept : msg(std::exchange(other.msg, nullptr)) {}
+
+    ~MsgPtr() { reset(); }
+
+    MsgPtr &operator=(const MsgPtr &other) noexcept {
+        if (this != &other) {
+            MsgPtr(other).swap(*this);
+        }
+        return *this;
+    }
+
+    MsgPtr &operator=(MsgPtr &&other) noexcept {
+        if (this != &other) {
+            reset();
+            msg = std::exchange(other.msg, nullptr);
+        }
+        return *this;
+    }
+
+    void reset() noexcept {
+        if (msg && msg->refcount.fetch_sub(1, std::memory_order::acq_rel) == 1) {
+            Msg::destroy(msg);
+        }
+        msg = nullptr;
+    }
+
+    // give the reference away, e.g. to store the message in a C-style container, and get it back with MsgPtr(Msg *)
+    Msg *release() noexcept { return std::exchange(msg, nullptr); }
+
+    void swap(MsgPtr &other) noexcept { std::swap(msg, other.msg); }
+
+    bool unique() const noexcept { return msg && msg->refcount.load(std::memory_order::acquire) == 1; }
+
+    Msg *get() const noexcept { return msg; }
+
+    Msg *operator->() const noexcept { return msg; }
+
+    Msg &operator*() const noexcept { return *msg; }
+
+    explicit operator bool() const noexcept { return msg != nullptr; }
+
+  private:
+    Msg *msg = nullptr;
+};
+
+inline MsgPtr Msg::create(MsgType type, size_t capacity, size_t headroom, size_t tailroom) {
+    const size_t room_size = capacity > 0 ? headroom + capacity + tailroom : 0;
+    const size_t block_size = (HEADER_SIZE + room_size + Pool::ALIGNMENT - 1) & ~(Pool::ALIGNMENT - 1);
+    const PoolType pool = block_size <= SMALL_BUFFER_SIZE ? SMALL_POOL : block_size <= BUFFER_SIZE ? PACKET_POOL : NO_POOL;
+    void *block = pool == SMALL_POOL    ? SmallPool::allocate()
+                  : pool == PACKET_POOL ? Pool::allocate()
+                                        : std::aligned_alloc(Pool::ALIGNMENT, block_size);
+    Msg *msg = new (block) Msg;
+    msg->type = type;
+    msg->pool = pool;
+    msg->room_size = static_cast<uint32_t>(room_size);
+    if (capacity > 0) {
+        msg->data = msg->room() + headroom;
+    }
+
+    return MsgPtr(msg);
+}
+
+inline MsgPtr Msg::retag(MsgPtr &&msg, MsgType type) {
+    if (msg.unique()) {
+        msg->type = type;
+        return std::move(msg);
+    }
+
+    auto view = create(type);
+    view->data = msg->data;
+    view->size = msg->size;
+    view->extra = msg->extra;
+    view->parent = msg.release();
+    return view;
+}
+
+inline MsgPtr Msg::writable(MsgPtr &&msg) {
+    if (msg.unique() && !msg->parent) {
+        return std::move(msg);
+    }
+
+    auto copy = create(msg->type, msg->size, std::max(msg->headroom(), DEFAULT_HEADROOM), std::max(msg->tailroom(), DEFAULT_TAILROOM));
+    if (msg->size > 0) {
+        std::memcpy(copy->data, msg->data, msg->size);
+    }
+    copy->size = msg->size;
+    copy->extra = msg->extra;
+    return copy;
+}
+
+inline MsgPtr Msg::control(MsgType type, uint64_t value) {
+    auto msg = create(type);
+    msg->extra = value;
+    return msg;
+}
+
+inline MsgPtr Msg::fromPacket(void *block, MsgType type, size_t size) {
+    Msg *msg = new (block) Msg;
+    msg->type = type;
+    msg->pool = PACKET_POOL;
+    msg->room_size = static_cast<uint32_t>(DEFAULT_HEADROOM + CAPACITY + DEFAULT_TAILROOM);
+    msg->data = packetPayload(block);
+    msg->size = static_cast<ssize_t>(size);
+    return MsgPtr(msg);
+}
+
+inline void Msg::destroy(Msg *msg) noexcept {
+    Msg *parent = msg->parent;
+    const PoolType pool = msg->pool;
+    msg->~Msg();
+    switch (pool) {
+    case SMALL_POOL:
+        SmallPool::release(msg);
+        break;
+    case PACKET_POOL:
+        Pool::release(msg);
+        break;
+    default:
+        std::free(msg);
+        break;
+    }
+    // drop the reference the view had on the payload owner
+    MsgPtr owner(parent);
+}
+
+#endif // SCREAM_MSG_H
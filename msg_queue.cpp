@@ -0,0 +1,385 @@
+extern "C" {
+#include <unistd.h>
+}
+
+#include <bit>
+#include <charconv>
+#include <string_view>
+
+#include "logger.h"
+#include "msg_queue.h"
+
+static constexpr std::array<const char *, Msg::TYPE_COUNT> TYPE_NAMES = {
+    "NONE", "RAW", "RTP_PACKET", "RTCP_PACKET", "BITRATE_REQUEST", "IFRAME_REQUEST",
+};
+
+static constexpr std::array POLICY_NAMES = {"drop_oldest", "drop_newest", "block", "coalesce_latest"};
+
+static constexpr std::array LANE_NAMES = {"control", "interactive", "media"};
+
+static constexpr std::array WAIT_STRATEGY_NAMES = {"blocking", "spin_then_park", "busy_spin"};
+
+// spinning iterations between two clock reads
+static constexpr uint32_t SPIN_CLOCK_INTERVAL = 64;
+
+MsgQueue::MsgQueue(std::string name, size_t capacity) : name(std::move(name)), capacity(capacity) {
+    // media goes stale, a late packet is worth less than the one behind it; control messages only carry a last value
+    policies.fill(DROP_OLDEST);
+    policies[Msg::NONE] = DROP_NEWEST;
+    policies[Msg::BITRATE_REQUEST] = COALESCE_LATEST;
+    policies[Msg::IFRAME_REQUEST] = COALESCE_LATEST;
+
+    lanes_by_type.fill(MEDIA);
+    lanes_by_type[Msg::RTCP_PACKET] = INTERACTIVE;
+    lanes_by_type[Msg::BITRATE_REQUEST] = CONTROL;
+    lanes_by_type[Msg::IFRAME_REQUEST] = CONTROL;
+}
+
+bool MsgQueue::setPolicies(const std::string &spec) {
+    std::string_view rest = spec;
+    while (!rest.empty()) {
+        const size_t comma = rest.find(',');
+        const std::string_view item = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+        const size_t equal = item.find('=');
+        if (equal == std::string_view::npos) {
+            return false;
+        }
+        const auto type = std::find(TYPE_NAMES.begin(), TYPE_NAMES.end(), item.substr(0, equal));
+        const auto policy = std::find(POLICY_NAMES.begin(), POLICY_NAMES.end(), item.substr(equal + 1));
+        if (type == TYPE_NAMES.end() || policy == POLICY_NAMES.end()) {
+            return false;
+        }
+        policies[type - TYPE_NAMES.begin()] = static_cast<OverflowPolicy>(policy - POLICY_NAMES.begin());
+    }
+
+    return true;
+}
+
+bool MsgQueue::setWeights(const std::string &spec) {
+    std::array<uint32_t, LANE_COUNT> parsed = {};
+    if (spec != "strict") {
+        const char *first = spec.data();
+        const char *const last = spec.data() + spec.size();
+        for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+            const auto [ptr, ec] = std::from_chars(first, last, parsed[lane]);
+            if (ec != std::errc() || parsed[lane] == 0 || (lane + 1 < LANE_COUNT ? ptr == last || *ptr != ',' : ptr != last)) {
+                return false;
+            }
+            first = ptr + 1;
+        }
+    }
+
+    weights = parsed;
+    return true;
+}
+
+bool MsgQueue::setWaitStrategy(const std::string &spec) {
+    const auto strategy = std::find(WAIT_STRATEGY_NAMES.begin(), WAIT_STRATEGY_NAMES.end(), spec);
+    if (strategy == WAIT_STRATEGY_NAMES.end()) {
+        return false;
+    }
+
+    wait_strategy = static_cast<WaitStrategy>(strategy - WAIT_STRATEGY_NAMES.begin());
+    return true;
+}
+
+MsgQueue::LaneStats MsgQueue::getLaneStats(Lane lane) const {
+    return {
+        lanes[lane].count.load(std::memory_order::relaxed),
+        lanes[lane].total_delay.load(std::memory_order::relaxed),
+        lanes[lane].max_delay.load(std::memory_order::relaxed),
+    };
+}
+
+bool MsgQueue::enqueue(Lane lane, MsgPtr &&msg) { return enqueue_bulk(lane, std::make_move_iterator(&msg), 1); }
+
+const char *MsgQueue::typeName(Msg::MsgType type) { return TYPE_NAMES[type]; }
+
+bool MsgQueue::parseType(std::string_view name, Msg::MsgType &type) {
+    const auto it = std::find(TYPE_NAMES.begin(), TYPE_NAMES.end(), name);
+    if (it == TYPE_NAMES.end()) {
+        return false;
+    }
+
+    type = static_cast<Msg::MsgType>(it - TYPE_NAMES.begin());
+    return true;
+}
+
+bool MsgQueue::parseLane(std::string_view name, Lane &lane) {
+    const auto it = std::find(LANE_NAMES.begin(), LANE_NAMES.end(), name);
+    if (it == LANE_NAMES.end()) {
+        return false;
+    }
+
+    lane = static_cast<Lane>(it - LANE_NAMES.begin());
+    return true;
+}
+
+bool MsgQueue::coalesce(Lane lane, MsgPtr &&msg) {
+    const Msg::MsgType type = msg->type;
+    CoalesceSlot &slot = slots[type];
+    // the lane gets a token of the right type, the consumer swaps it for whatever is latest when it gets there
+    MsgPtr token = msg;
+    slot.lock.lock();
+    slot.latest.swap(msg);
+    slot.lock.unlock();
+
+    // a token is already waiting, the replaced message is the dropped one
+    if (msg) {
+        drop(type, 1);
+        return true;
+    }
+
+    depth.fetch_add(1, std::memory_order::acq_rel);
+    return push(lane, std::make_move_iterator(&token), 1);
+}
+
+bool MsgQueue::waitForRoom(size_t count) {
+    const auto deadline = std::chrono::steady_clock::now() + BLOCK_TIMEOUT;
+    while (true) {
+        size_t current = depth.load(std::memory_order::relaxed);
+        // a burst larger than the whole capacity goes in once the queue is empty
+        while (current == 0 || current + count <= capacity) {
+            if (depth.compare_exchange_weak(current, current + count, std::memory_order::acq_rel)) {
+                return true;
+            }
+        }
+
+        const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            return false;
+        }
+
+        // announced before looking at the depth again, either the consumer sees this producer waiting or this sees the
+        // room it made
+        blocked.fetch_add(1, std::memory_order::seq_cst);
+        current = depth.load(std::memory_order::seq_cst);
+        if (current != 0 && current + count > capacity) {
+            room.wait(remaining.count());
+        }
+        blocked.fetch_sub(1, std::memory_order::relaxed);
+    }
+}
+
+void MsgQueue::freed() {
+    // pairs with the announcement in waitForRoom(), a spare count only costs a blocked producer one more look
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    if (const size_t waiting = blocked.load(std::memory_order::relaxed); waiting > 0) {
+        room.signal(static_cast<ssize_t>(waiting));
+    }
+}
+
+size_t MsgQueue::dropOldest(Lane lane, size_t count) {
+    // claim the messages first, as the consumer does, so that it never waits for one taken here
+    const auto claimed = static_cast<size_t>(items.tryWaitMany(static_cast<ssize_t>(count)));
+    std::array<Entry, BATCH_SIZE> old;
+    size_t taken = 0;
+    size_t removed = 0;
+    for (size_t n; taken < claimed && (n = lanes[lane].queue.try_dequeue_bulk(old.begin(), std::min(old.size(), claimed - taken))) > 0;
+         taken += n) {
+        for (size_t i = 0; i < n; ++i) {
+            const Msg::MsgType type = old[i].msg->type;
+            // coalesced tokens go back to the tail, their slot would be stuck otherwise; there is at most one per type
+            if (policies[type] == COALESCE_LATEST) {
+                lanes[lane].queue.enqueue(std::move(old[i]));
+                signal(1);
+            } else {
+                old[i].msg.reset();
+                drop(type, 1);
+                ++removed;
+            }
+        }
+    }
+
+    // claims on messages of the other lanes
+    if (claimed > taken) {
+        signal(claimed - taken);
+    }
+    return removed;
+}
+
+void MsgQueue::drop(Msg::MsgType type, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    // only when the total crosses a power of two, an overloaded queue must not flood the log
+    const uint64_t total = dropped[type].fetch_add(count, std::memory_order::relaxed) + count;
+    if (std::bit_floor(total) > total - count) {
+        logger::log(policies[type] == COALESCE_LATEST ? logger::DEBUG : logger::WARNING, name, ": ", total, " ", TYPE_NAMES[type],
+                    " messages dropped (", POLICY_NAMES[policies[type]], ")");
+    }
+}
+
+bool MsgQueue::arm() {
+    armed.store(true, std::memory_order::seq_cst);
+    // pairs with the fence in signal(), either the producer sees the flag or this sees its messages
+    if (items.availableApprox() > 0) {
+        armed.store(false, std::memory_order::relaxed);
+        return false;
+    }
+    return true;
+}
+
+void MsgQueue::signal(size_t count) {
+    items.signal(static_cast<ssize_t>(count));
+    if (const int fd = notify_fd.load(std::memory_order::acquire); fd >= 0) {
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (armed.load(std::memory_order::relaxed) && armed.exchange(false, std::memory_order::acq_rel)) {
+            const uint64_t one = 1;
+            (void)::write(fd, &one, sizeof(one));
+        }
+    }
+}
+
+ssize_t MsgQueue::wait(ssize_t max, std::chrono::microseconds timeout) {
+    // negative for no timeout
+    if (wait_strategy == BLOCKING) {
+        return items.waitMany(max, timeout.count());
+    }
+
+    const bool forever = timeout.count() < 0;
+    const auto start = std::chrono::steady_clock::now();
+    const auto spin_end = wait_strategy == BUSY_SPIN ? (forever ? std::chrono::steady_clock::time_point::max() : start + timeout)
+                                                     : start + (forever ? spin_time : std::min(spin_time, timeout));
+    for (uint32_t i = 1;; ++i) {
+        // a plain load first, so that spinning does not steal the cache line from producers
+        if (items.availableApprox() > 0) {
+            if (const ssize_t count = items.tryWaitMany(max); count > 0) {
+                return count;
+            }
+        }
+        __builtin_ia32_pause();
+        if (i % SPIN_CLOCK_INTERVAL == 0 && std::chrono::steady_clock::now() >= spin_end) {
+            break;
+        }
+    }
+
+    if (forever) {
+        return items.waitMany(max, -1);
+    }
+
+    const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(timeout - (std::chrono::steady_clock::now() - start));
+    if (wait_strategy == BUSY_SPIN || remaining.count() <= 0) {
+        return items.tryWaitMany(max);
+    }
+    return items.waitMany(max, remaining.count());
+}
+
+size_t MsgQueue::dequeue(MsgPtr *msgs, ssize_t count) {
+    // a count from wake() has no message behind it
+    for (size_t pending = wakeups.load(std::memory_order::relaxed); count > 0 && pending > 0;) {
+        if (wakeups.compare_exchange_weak(pending, pending - 1, std::memory_order::relaxed)) {
+            --count;
+        }
+    }
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    // the semaphore vouches for count messages already in the lanes
+    const auto claimed = static_cast<size_t>(count);
+    const int64_t time = now();
+    size_t taken = 0;
+    const bool strict = std::all_of(weights.begin(), weights.end(), [](uint32_t weight) { return weight == 0; });
+    while (taken < claimed) {
+        if (strict) {
+            for (size_t lane = 0; lane < LANE_COUNT && taken < claimed; ++lane) {
+                taken += take(static_cast<Lane>(lane), msgs + taken, claimed - taken, time);
+            }
+            continue;
+        }
+
+        if (credit == 0) {
+            credit = std::max<uint32_t>(weights[current_lane], 1);
+        }
+        const size_t wanted = std::min<size_t>(credit, claimed - taken);
+        const size_t n = take(static_cast<Lane>(current_lane), msgs + taken, wanted, time);
+        taken += n;
+        credit -= n;
+        // credit used up or lane empty, next one's turn
+        if (credit == 0 || n < wanted) {
+            credit = 0;
+            current_lane = (current_lane + 1) % LANE_COUNT;
+        }
+    }
+
+    depth.fetch_sub(claimed, std::memory_order::acq_rel);
+    freed();
+    if (time - last_report >= std::chrono::duration_cast<std::chrono::nanoseconds>(REPORT_PERIOD).count()) {
+        report(time);
+    }
+    return complete(msgs, claimed);
+}
+
+size_t MsgQueue::take(Lane lane, MsgPtr *msgs, size_t count, int64_t time) {
+    LaneQueue &queue = lanes[lane];
+    std::array<Entry, BATCH_SIZE> entries;
+    size_t taken = 0;
+    for (size_t n; taken < count && (n = queue.queue.try_dequeue_bulk(entries.begin(), std::min(entries.size(), count - taken))) > 0; taken += n) {
+        uint64_t total = 0;
+        uint64_t max = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const auto delay = static_cast<uint64_t>(std::max<int64_t>(time - entries[i].enqueued, 0));
+            total += delay;
+            max = std::max(max, delay);
+            msgs[taken + i] = std::move(entries[i].msg);
+        }
+
+        queue.count.fetch_add(n, std::memory_order::relaxed);
+        queue.total_delay.fetch_add(total, std::memory_order::relaxed);
+        if (max > queue.max_delay.load(std::memory_order::relaxed)) {
+            queue.max_delay.store(max, std::memory_order::relaxed);
+        }
+    }
+
+    return taken;
+}
+
+size_t MsgQueue::complete(MsgPtr *msgs, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (policies[msgs[i]->type] == COALESCE_LATEST) {
+            CoalesceSlot &slot = slots[msgs[i]->type];
+            MsgPtr latest;
+            slot.lock.lock();
+            latest.swap(slot.latest);
+            slot.lock.unlock();
+            msgs[i] = std::move(latest);
+            if (!msgs[i]) {
+                continue;
+            }
+        }
+
+        if (kept != i) {
+            msgs[kept] = std::move(msgs[i]);
+        }
+        ++kept;
+    }
+
+    return kept;
+}
+
+void MsgQueue::report(int64_t time) {
+    std::string lanes_text;
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        const LaneStats stats = getLaneStats(static_cast<Lane>(lane));
+        const uint64_t count = stats.count - reported[lane].count;
+        if (count > 0) {
+            lanes_text += std::string(", ") + LANE_NAMES[lane] + " n=" + std::to_string(count) +
+                          " mean=" + std::to_string((stats.total_delay - reported[lane].total_delay) / count / 1000) +
+                          "us max=" + std::to_string(stats.max_delay / 1000) + "us";
+            lanes[lane].max_delay.store(0, std::memory_order::relaxed);
+        }
+        reported[lane] = stats;
+    }
+
+    // nothing on the very first call, the counters only start there
+    if (last_report != 0) {
+        logger::log(logger::DEBUG, name, ": ", WAIT_STRATEGY_NAMES[wait_strategy], " wait, dequeue latency", lanes_text);
+    }
+    last_report = time;
+}
@@ -0,0 +1,283 @@
+#ifndef SCREAM_MSGQUEUE_H
+#define SCREAM_MSGQUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include "concurrentqueue/concurrentqueue.h"
+#include "concurrentqueue/lightweightsemaphore.h"
+
+#include "hybrid_lock.h"
+#include "msg.h"
+
+// Bounded queue of messages. Once capacity messages are waiting, what happens to a new one depends on the overflow
+// policy of its type: the oldest waiting message is dropped (media), the new one is dropped, the producer waits for
+// some room (up to BLOCK_TIMEOUT, then the new one is dropped) or, for control messages where only the last value
+// matters, the waiting message of the same type is replaced. Every dropped message is counted per type.
+//
+// Messages wait in one of several lanes, picked by the producer (see Source::registerQueue) or by message type. The
+// consumer drains the lanes in order, either strictly or a weighted number of messages per lane and per round, and the
+// time spent in each lane is measured. A single semaphore counts the messages of all lanes, so a consumer sleeps the
+// same way whatever lane wakes it up.
+//
+// How the consumer waits is a trade of CPU for latency: blocking parks the thread on the semaphore right away, busy
+// spinning never gives the core back, spinning then parking covers short gaps and sleeps through long ones. The
+// queueing delay of each lane, which includes the wakeup latency of the consumer, is logged every REPORT_PERIOD. A
+// consumer driven by epoll instead (see Reactor) gets an eventfd written when messages arrive while it is idle.
+class MsgQueue {
+  public:
+    enum OverflowPolicy {
+        DROP_OLDEST,
+        DROP_NEWEST,
+        BLOCK,
+        COALESCE_LATEST,
+    };
+
+    enum Lane {
+        CONTROL,
+        INTERACTIVE,
+        MEDIA,
+    };
+
+    static constexpr size_t LANE_COUNT = MEDIA + 1;
+
+    enum WaitStrategy {
+        BLOCKING,
+        SPIN_THEN_PARK,
+        BUSY_SPIN,
+    };
+
+    static constexpr auto DEFAULT_SPIN_TIME = std::chrono::microseconds(50);
+    static constexpr auto REPORT_PERIOD = std::chrono::seconds(10);
+
+    static constexpr auto BLOCK_TIMEOUT = std::chrono::milliseconds(100);
+
+    // queueing delays in ns, the max is the one since the last report
+    struct LaneStats {
+        uint64_t count;
+        uint64_t total_delay;
+        uint64_t max_delay;
+    };
+
+    MsgQueue(std::string name, size_t capacity);
+
+    const std::string &getName() const { return name; }
+
+    void setCapacity(size_t capacity) { this->capacity = capacity; }
+
+    size_t getCapacity() const { return capacity; }
+
+    void setPolicy(Msg::MsgType type, OverflowPolicy policy) { policies[type] = policy; }
+
+    // comma separated list of type=policy, e.g. "RAW=drop_newest,BITRATE_REQUEST=coalesce_latest"
+    bool setPolicies(const std::string &spec);
+
+    OverflowPolicy getPolicy(Msg::MsgType type) const { return policies[type]; }
+
+    uint64_t getDropped(Msg::MsgType type) const { return dropped[type].load(std::memory_order::relaxed); }
+
+    // lane of the messages of this type when the producer does not pick one
+    void setLane(Msg::MsgType type, Lane lane) { lanes_by_type[type] = lane; }
+
+    Lane getLane(Msg::MsgType type) const { return lanes_by_type[type]; }
+
+    // messages taken from each lane per round, all zeros for strict priority (the default); only set it before the
+    // consumer starts
+    void setWeights(const std::array<uint32_t, LANE_COUNT> &weights) { this->weights = weights; }
+
+    // "strict" or comma separated weights in lane order, e.g. "8,4,1"
+    bool setWeights(const std::string &spec);
+
+    LaneStats getLaneStats(Lane lane) const;
+
+    // only set it before the consumer starts
+    void setWaitStrategy(WaitStrategy strategy) { wait_strategy = strategy; }
+
+    // "blocking", "spin_then_park" or "busy_spin"
+    bool setWaitStrategy(const std::string &spec);
+
+    WaitStrategy getWaitStrategy() const { return wait_strategy; }
+
+    // how long SPIN_THEN_PARK spins before parking
+    void setSpinTime(std::chrono::microseconds spin_time) { this->spin_time = spin_time; }
+
+    bool enqueue(MsgPtr &&msg) { return enqueue(lanes_by_type[msg->type], std::move(msg)); }
+
+    bool enqueue(const MsgPtr &msg) { return enqueue(MsgPtr(msg)); }
+
+    bool enqueue(Lane lane, MsgPtr &&msg);
+
+    // the whole range must be of the same type, as Source::forward() hands it
+    template <typename It> bool enqueue_bulk(It first, size_t count) {
+        return count == 0 || enqueue_bulk(lanes_by_type[(*first)->type], first, count);
+    }
+
+    template <typename It> bool enqueue_bulk(Lane lane, It first, size_t count);
+
+    bool try_dequeue(MsgPtr &msg) { return dequeue(&msg, items.tryWaitMany(1)) > 0; }
+
+    size_t try_dequeue_bulk(MsgPtr *msgs, size_t max) { return dequeue(msgs, items.tryWaitMany(static_cast<ssize_t>(max))); }
+
+    template <typename Rep, typename Period> bool wait_dequeue_timed(MsgPtr &msg, const std::chrono::duration<Rep, Period> &timeout) {
+        return wait_dequeue_bulk_timed(&msg, 1, timeout) > 0;
+    }
+
+    // the returned count can be lower than the number of messages taken from the lanes (coalesced leftovers), even 0
+    template <typename Rep, typename Period>
+    size_t wait_dequeue_bulk_timed(MsgPtr *msgs, size_t max, const std::chrono::duration<Rep, Period> &timeout) {
+        return dequeue(msgs, wait(static_cast<ssize_t>(max), std::chrono::duration_cast<std::chrono::microseconds>(timeout)));
+    }
+
+    // no timeout, returns with messages or after a wake(), 0 then
+    size_t wait_dequeue_bulk(MsgPtr *msgs, size_t max) { return dequeue(msgs, wait(static_cast<ssize_t>(max), std::chrono::microseconds(-1))); }
+
+    // the consumer waiting, or the next one to wait, returns at once, e.g. to see that its block is stopping
+    void wake() {
+        wakeups.fetch_add(1, std::memory_order::relaxed);
+        signal(1);
+    }
+
+    size_t size_approx() const { return depth.load(std::memory_order::relaxed); }
+
+    // eventfd to write to when messages arrive after arm(), -1 for none; the fd must stay open as long as producers run
+    void setNotifier(int fd) { notify_fd.store(fd, std::memory_order::release); }
+
+    // called by the consumer before waiting for the notifier, false if messages arrived meanwhile and the notifier is
+    // not armed
+    bool arm();
+
+    static const char *typeName(Msg::MsgType type);
+
+    // from the names typeName() gives and the lower case lane names, e.g. "RTP_PACKET" or "control"; false when unknown
+    static bool parseType(std::string_view name, Msg::MsgType &type);
+    static bool parseLane(std::string_view name, Lane &lane);
+
+  private:
+    struct Entry {
+        MsgPtr msg;
+        // steady clock, in ns
+        int64_t enqueued;
+    };
+
+    struct alignas(64) LaneQueue {
+        moodycamel::ConcurrentQueue<Entry> queue;
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> total_delay = 0;
+        std::atomic<uint64_t> max_delay = 0;
+    };
+
+    struct alignas(64) CoalesceSlot {
+        HybridLock lock;
+        MsgPtr latest;
+    };
+
+    static constexpr size_t BATCH_SIZE = 32;
+
+    static int64_t now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    template <typename It> bool push(Lane lane, It first, size_t count);
+    bool coalesce(Lane lane, MsgPtr &&msg);
+    bool waitForRoom(size_t count);
+    void freed();
+    size_t dropOldest(Lane lane, size_t count);
+    void drop(Msg::MsgType type, uint64_t count);
+    void signal(size_t count);
+    ssize_t wait(ssize_t max, std::chrono::microseconds timeout);
+    size_t dequeue(MsgPtr *msgs, ssize_t count);
+    size_t take(Lane lane, MsgPtr *msgs, size_t count, int64_t time);
+    size_t complete(MsgPtr *msgs, size_t count);
+    void report(int64_t time);
+
+    std::string name;
+    size_t capacity;
+    std::array<OverflowPolicy, Msg::TYPE_COUNT> policies;
+    std::array<Lane, Msg::TYPE_COUNT> lanes_by_type;
+    std::array<uint32_t, LANE_COUNT> weights = {};
+    std::array<LaneQueue, LANE_COUNT> lanes;
+    // one count per message in the lanes, taken before dequeuing from them, plus one per pending wake()
+    moodycamel::LightweightSemaphore items;
+    std::atomic<size_t> wakeups = 0;
+    // producers of BLOCK messages waiting for room, woken up through room each time the consumer takes messages
+    std::atomic<size_t> blocked = 0;
+    moodycamel::LightweightSemaphore room;
+    // messages in the lanes, coalesced ones count for one
+    alignas(64) std::atomic<size_t> depth = 0;
+    std::atomic<int> notify_fd = -1;
+    std::atomic<bool> armed = false;
+    WaitStrategy wait_strategy = BLOCKING;
+    std::chrono::microseconds spin_time = DEFAULT_SPIN_TIME;
+    // weighted round and report state, only touched by the consumer
+    size_t current_lane = 0;
+    uint32_t credit = 0;
+    int64_t last_report = 0;
+    std::array<LaneStats, LANE_COUNT> reported = {};
+    std::array<CoalesceSlot, Msg::TYPE_COUNT> slots;
+    std::array<std::atomic<uint64_t>, Msg::TYPE_COUNT> dropped = {};
+};
+
+template <typename It> bool MsgQueue::enqueue_bulk(Lane lane, It first, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+
+    const Msg::MsgType type = (*first)->type;
+    switch (policies[type]) {
+    case COALESCE_LATEST:
+        // only the last one matters
+        drop(type, count - 1);
+        return coalesce(lane, MsgPtr(*(first + (count - 1))));
+    case BLOCK:
+        if (!waitForRoom(count)) {
+            drop(type, count);
+            return false;
+        }
+        return push(lane, first, count);
+    default:
+        break;
+    }
+
+    const size_t before = depth.fetch_add(count, std::memory_order::acq_rel);
+    const size_t excess = std::min(count, before + count > capacity ? before + count - capacity : 0);
+    if (excess == 0) {
+        return push(lane, first, count);
+    }
+
+    if (policies[type] == DROP_NEWEST) {
+        depth.fetch_sub(excess, std::memory_order::acq_rel);
+        drop(type, excess);
+        return count > excess && push(lane, first, count - excess);
+    }
+
+    // DROP_OLDEST, make room from the head of the lane, the rest comes from the head of the burst itself
+    const size_t skipped = excess - dropOldest(lane, excess);
+    depth.fetch_sub(excess, std::memory_order::acq_rel);
+    drop(type, skipped);
+    return push(lane, first + skipped, count - skipped);
+}
+
+template <typename It> bool MsgQueue::push(Lane lane, It first, size_t count) {
+    const int64_t time = now();
+    std::array<Entry, BATCH_SIZE> entries;
+    for (size_t done = 0, n; done < count; done += n) {
+        n = std::min(entries.size(), count - done);
+        for (size_t i = 0; i < n; ++i, ++first) {
+            entries[i] = {MsgPtr(*first), time};
+        }
+
+        // counted only once they are visible in the lane
+        if (!lanes[lane].queue.enqueue_bulk(std::make_move_iterator(entries.begin()), n)) {
+            depth.fetch_sub(count - done, std::memory_order::acq_rel);
+            drop(entries[0].msg->type, count - done);
+            return false;
+        }
+        signal(n);
+    }
+
+    return true;
+}
+
+#endif // SCREAM_MSGQUEUE_H
@@ -1,23 +1,27 @@
+#include <charconv>
+#include <limits>
+
 #include "msg_type_converter.h"
 
-template <> std::shared_ptr<Msg> MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW>::convert(const std::shared_ptr<const Msg> &msg) {
-    auto msg2 = std::make_shared<Msg>();
-    msg2->type = Msg::RAW;
-    msg2->data = aligned_alloc(64, 64);
+// enough for the tcp frame header, so that the json messages can be framed in place
+constexpr size_t JSON_HEADROOM = 8;
+
+template <> MsgPtr MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW>::convert(MsgPtr &&msg) {
     static constexpr std::string_view json = R"({"t":"n","v":)";
-    std::memcpy(msg2->data, json.data(), json.size());
-    auto val = std::to_string(msg->size);
-    std::memcpy(static_cast<char *>(msg2->data) + json.size(), val.c_str(), val.size());
-    static_cast<char *>(msg2->data)[json.size() + val.size()] = '}';
-    msg2->size = json.size() + val.size() + 1;
+    // the value is signed, a negative bitrate tells the encoder to send an I-frame
+    static constexpr size_t capacity = json.size() + std::numeric_limits<int64_t>::digits10 + 2 + 1;
+    auto msg2 = Msg::create(Msg::RAW, capacity, JSON_HEADROOM, 0);
+    auto *const out = static_cast<char *>(msg2->data);
+    std::memcpy(out, json.data(), json.size());
+    char *end = std::to_chars(out + json.size(), out + capacity - 1, static_cast<int64_t>(msg->extra)).ptr;
+    *end++ = '}';
+    msg2->size = end - out;
     return msg2;
 }
 
-template <> std::shared_ptr<Msg> MsgTypeConverter<Msg::IFRAME_REQUEST, Msg::RAW>::convert(const std::shared_ptr<const Msg> &msg) {
+template <> MsgPtr MsgTypeConverter<Msg::IFRAME_REQUEST, Msg::RAW>::convert(MsgPtr &&msg) {
     static constexpr std::string_view json = R"({"t":"n","v":-1})";
-    auto msg2 = std::make_shared<Msg>();
-    msg2->type = Msg::RAW;
-    msg2->data = aligned_alloc(64, json.size());
+    auto msg2 = Msg::create(Msg::RAW, json.size(), JSON_HEADROOM, 0);
     std::memcpy(msg2->data, json.data(), json.size());
     msg2->size = json.size();
     return msg2;
@@ -3,44 +3,72 @@
 
 #include <cstring>
 
+#include "logger.h"
 #include "simple_block.h"
 #include "sink.h"
 #include "source.h"
 
-template <Msg::MsgType U, Msg::MsgType V> class MsgTypeConverter : public SimpleBlock, public Sink, public Source {
+// Runs either as its own block, fed by its queue, or inline as a MsgHandler registered on the upstream Source, in
+// which case start() is not needed and the conversion costs neither a queue hop nor a thread wakeup. Its Stage does the
+// same conversion as a step of a Pipeline.
+template <Msg::MsgType U, Msg::MsgType V> class MsgTypeConverter : public SimpleBlock, public Sink, public Source, public MsgHandler {
   public:
-    explicit MsgTypeConverter(std::string name) : SimpleBlock(std::move(name)) {}
+    // drops the messages of other types
+    struct Stage {
+        MsgPtr operator()(MsgPtr &&msg) const { return msg->type == U ? apply(std::move(msg)) : MsgPtr(); }
+    };
+
+    // lets the messages of other types through, e.g. to chain the converters of several types
+    struct PassStage {
+        MsgPtr operator()(MsgPtr &&msg) const { return msg->type == U ? apply(std::move(msg)) : std::move(msg); }
+    };
+
+    explicit MsgTypeConverter(std::string name) : SimpleBlock(name), Sink(std::move(name)) {}
 
     ~MsgTypeConverter() override = default;
 
-    void init(const std::unordered_map<std::string, std::string> &params) override { initialized = true; }
+    void init(const std::unordered_map<std::string, std::string> &params) override {
+        for (auto const &[key, val] : params) {
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
+        }
+        initialized = true;
+    }
+
+    void handle(MsgPtr *msgs, size_t count) override {
+        size_t converted = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (msgs[i]->type == U) {
+                msgs[converted++] = apply(std::move(msgs[i]));
+            }
+        }
+
+        std::for_each(msgs + converted, msgs + count, [](MsgPtr &msg) { msg.reset(); });
+        forward(msgs, converted);
+    }
 
   private:
     void run() override {
-        std::shared_ptr<const Msg> msg;
+        std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
         while (!stop_condition.load(std::memory_order::relaxed)) {
-            if (own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY) && msg->type == U) {
-                forward(U == V ? msg : convert(msg));
-            }
+            handle(msgs.data(), own_queue->wait_dequeue_bulk(msgs.data(), msgs.size()));
         }
     }
 
-    std::shared_ptr<Msg> convert(const std::shared_ptr<const Msg> &msg) {
+    static MsgPtr apply(MsgPtr &&msg) { return U == V ? std::move(msg) : convert(std::move(msg)); }
+
+    // RAW and PACKET types share the same payload, only the tag changes
+    static MsgPtr convert(MsgPtr &&msg) {
         static_assert((U == Msg::RAW && (V == Msg::RTP_PACKET || V == Msg::RTCP_PACKET)) ||
                           (V == Msg::RAW && (U == Msg::RTP_PACKET || U == Msg::RTCP_PACKET)),
                       "non-specialized template is for RAW to PACKET types and vice-versa");
-        auto msg2 = std::make_shared<Msg>();
-        msg2->type = V;
-        msg2->data = std::aligned_alloc(64, msg->size);
-        std::memcpy(msg2->data, msg->data, msg->size);
-        msg2->size = msg->size;
-        msg2->extra = msg->extra;
-        return msg2;
+        return Msg::retag(std::move(msg), V);
     }
 };
 
-template <> std::shared_ptr<Msg> MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW>::convert(const std::shared_ptr<const Msg> &msg);
+template <> MsgPtr MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW>::convert(MsgPtr &&msg);
 
-template <> std::shared_ptr<Msg> MsgTypeConverter<Msg::IFRAME_REQUEST, Msg::RAW>::convert(const std::shared_ptr<const Msg> &msg);
+template <> MsgPtr MsgTypeConverter<Msg::IFRAME_REQUEST, Msg::RAW>::convert(MsgPtr &&msg);
 
 #endif // SCREAM_MSGTYPECONVERTER_H
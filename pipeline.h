@@ -0,0 +1,75 @@
+#ifndef SCREAM_PIPELINE_H
+#define SCREAM_PIPELINE_H
+
+#include <tuple>
+#include <utility>
+
+#include "source.h"
+
+// Stages fused at compile time into one call chain, run in the thread of whatever Source it is registered on as a
+// handler; the survivors are then forwarded to its own subscribers. A stage is any type with
+//     MsgPtr operator()(MsgPtr &&msg)
+// returning the message to pass on, a new one, or nullptr to drop it. A message the upstream Source also handed to other
+// subscribers is shared, a stage changing it must work on a copy unless msg.unique(), as Msg::retag and Rewrite do. As
+// with any MsgHandler, stages are called from several threads when several sources feed the pipeline, so they should
+// not hold mutable state. Queues are left for the real thread boundaries.
+//
+// A block can also be given a pipeline as a MsgTransform and run it on what it dequeued, e.g. the tcp client turning
+// the scream requests into encoder commands once its queue coalesced them.
+class MsgTransform {
+  public:
+    virtual ~MsgTransform() = default;
+
+    // the survivors are moved to the front and their count returned, the other handles are left empty
+    virtual size_t transform(MsgPtr *msgs, size_t count) = 0;
+};
+
+template <typename... Stages> class Pipeline : public MsgHandler, public MsgTransform, public Source {
+  public:
+    Pipeline() = default;
+    explicit Pipeline(Stages... stages)
+        requires(sizeof...(Stages) > 0)
+        : stages(std::move(stages)...) {}
+
+    void handle(MsgPtr *msgs, size_t count) override { forward(msgs, transform(msgs, count)); }
+
+    size_t transform(MsgPtr *msgs, size_t count) override {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (MsgPtr msg = apply(std::move(msgs[i]), std::index_sequence_for<Stages...>{})) {
+                msgs[kept++] = std::move(msg);
+            }
+        }
+        return kept;
+    }
+
+  private:
+    template <size_t... I> MsgPtr apply(MsgPtr &&msg, std::index_sequence<I...>) {
+        // stops at the first stage dropping the message
+        (void)((msg = std::get<I>(stages)(std::move(msg))) && ...);
+        return std::move(msg);
+    }
+
+    std::tuple<Stages...> stages;
+};
+
+// keeps the messages the predicate, called with a const Msg &, is true for
+template <typename Predicate> struct Filter {
+    MsgPtr operator()(MsgPtr &&msg) const { return predicate(*msg) ? std::move(msg) : MsgPtr(); }
+
+    Predicate predicate;
+};
+
+// modifies the messages, e.g. to rewrite a protocol header, the function is called with a Msg &; a message shared with
+// other subscribers is copied first
+template <typename Function> struct Rewrite {
+    MsgPtr operator()(MsgPtr &&msg) const {
+        msg = Msg::writable(std::move(msg));
+        function(*msg);
+        return std::move(msg);
+    }
+
+    Function function;
+};
+
+#endif // SCREAM_PIPELINE_H
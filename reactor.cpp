@@ -0,0 +1,209 @@
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+}
+
+#include <array>
+#include <cstring>
+#include <string>
+
+#include "logger.h"
+#include "reactor.h"
+
+Reactor::Reactor(std::string name, size_t thread_count) : name(std::move(name)), lock(this->name) {
+    for (size_t i = 0; i < std::max<size_t>(thread_count, 1); ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (worker->epoll_fd < 0 || worker->wake_fd < 0) {
+            logger::log(logger::ERROR, this->name, ": fail to create epoll instance -> ", std::strerror(errno));
+        }
+
+        // a null tag stands for the wakeup fd
+        epoll_event event = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &event);
+        workers.push_back(std::move(worker));
+    }
+}
+
+Reactor::~Reactor() {
+    if (!stop_condition.load()) {
+        stop();
+    }
+
+    for (auto &registration : registrations) {
+        if (registration->queue && registration->active) {
+            registration->queue->setNotifier(-1);
+        }
+        if (registration->notify_fd >= 0) {
+            close(registration->notify_fd);
+        }
+    }
+    for (auto &worker : workers) {
+        close(worker->epoll_fd);
+        close(worker->wake_fd);
+    }
+}
+
+void Reactor::start(const ThreadConfig &config) {
+    if (!stop_condition.load()) {
+        logger::log(logger::INFO, name, ": thread(s) already started");
+        return;
+    }
+
+    stop_condition.store(false);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread([this, config, i] {
+            config.apply(name, std::to_string(i));
+            loop(*workers[i]);
+        });
+    }
+    logger::log(logger::INFO, name, ": started ", workers.size(), " I/O thread(s)");
+}
+
+void Reactor::stop() {
+    if (stop_condition.load()) {
+        logger::log(logger::INFO, name, ": thread(s) already stopped");
+        return;
+    }
+
+    stop_condition.store(true);
+    for (auto &worker : workers) {
+        notify(worker->wake_fd);
+        worker->thread.join();
+    }
+}
+
+bool Reactor::add(IoHandler *handler, int fd, const std::shared_ptr<MsgQueue> &queue) {
+    lock.lock();
+    // the calls of a handler never overlap, its other fds stay on the same thread
+    auto least_loaded =
+        std::min_element(workers.begin(), workers.end(), [](const auto &a, const auto &b) { return a->handler_count < b->handler_count; });
+    for (const auto &registration : registrations) {
+        if (registration->handler == handler && registration->active.load(std::memory_order::relaxed)) {
+            least_loaded = workers.begin() + static_cast<std::ptrdiff_t>(registration->worker);
+        }
+    }
+    Worker &worker = **least_loaded;
+
+    auto registration = std::make_unique<Registration>();
+    registration->handler = handler;
+    registration->fd = fd;
+    registration->queue = queue;
+    registration->notify_fd = queue ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+    registration->worker = least_loaded - workers.begin();
+    registration->active = true;
+    registration->fd_tag = {registration.get(), false};
+    registration->queue_tag = {registration.get(), true};
+
+    epoll_event fd_event = {.events = EPOLLIN, .data = {.ptr = &registration->fd_tag}};
+    epoll_event queue_event = {.events = EPOLLIN, .data = {.ptr = &registration->queue_tag}};
+    bool result = epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &fd_event) == 0;
+    if (result && queue) {
+        queue->setNotifier(registration->notify_fd);
+        result = epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, registration->notify_fd, &queue_event) == 0;
+        // messages queued before the registration
+        if (result && !queue->arm()) {
+            notify(registration->notify_fd);
+        }
+    }
+
+    if (result) {
+        ++worker.handler_count;
+    } else {
+        logger::log(logger::ERROR, name, ": fail to register fd ", fd, " -> ", std::strerror(errno));
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        registration->active = false;
+    }
+    registrations.push_back(std::move(registration));
+    lock.unlock();
+    return result;
+}
+
+void Reactor::remove(IoHandler *handler) {
+    lock.lock();
+    for (auto &registration : registrations) {
+        if (registration->handler != handler || !registration->active) {
+            continue;
+        }
+
+        Worker &worker = *workers[registration->worker];
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, registration->fd, nullptr);
+        if (registration->queue) {
+            epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, registration->notify_fd, nullptr);
+            registration->queue->setNotifier(-1);
+        }
+        registration->active.store(false, std::memory_order::release);
+        --worker.handler_count;
+
+        // the batch being handled may still hold events of the handler, wait for the next one to be done
+        if (!stop_condition.load() && std::this_thread::get_id() != worker.thread.get_id()) {
+            const uint64_t rounds = worker.rounds.load(std::memory_order::acquire);
+            notify(worker.wake_fd);
+            while (worker.rounds.load(std::memory_order::acquire) == rounds && !stop_condition.load()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    lock.unlock();
+}
+
+void Reactor::release(const std::shared_ptr<MsgQueue> &queue) {
+    lock.lock();
+    // registrations of fds with no queue have no producer to wait for, they go along
+    std::erase_if(registrations, [&queue](const auto &registration) {
+        if ((registration->queue && registration->queue != queue) || registration->active.load(std::memory_order::relaxed)) {
+            return false;
+        }
+        if (registration->notify_fd >= 0) {
+            close(registration->notify_fd);
+        }
+        return true;
+    });
+    lock.unlock();
+}
+
+void Reactor::loop(Worker &worker) {
+    std::array<epoll_event, MAX_EVENTS> events;
+    while (!stop_condition.load(std::memory_order::relaxed)) {
+        const int count = epoll_wait(worker.epoll_fd, events.data(), MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            logger::log(logger::ERROR, name, ": error while waiting for events -> ", std::strerror(errno));
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const auto *tag = static_cast<const Tag *>(events[i].data.ptr);
+            if (!tag) {
+                uint64_t value;
+                (void)read(worker.wake_fd, &value, sizeof(value));
+                continue;
+            }
+
+            Registration &registration = *tag->registration;
+            if (!registration.active.load(std::memory_order::acquire)) {
+                continue;
+            }
+
+            if (!tag->queue) {
+                registration.handler->onReadable();
+                continue;
+            }
+
+            uint64_t value;
+            (void)read(registration.notify_fd, &value, sizeof(value));
+            registration.handler->onQueue();
+            // some messages are left or arrived meanwhile, come back to them after the other events
+            if (!registration.queue->arm()) {
+                notify(registration.notify_fd);
+            }
+        }
+
+        worker.rounds.fetch_add(1, std::memory_order::release);
+    }
+}
+
+void Reactor::notify(int fd) {
+    const uint64_t one = 1;
+    (void)write(fd, &one, sizeof(one));
+}
@@ -0,0 +1,97 @@
+#ifndef SCREAM_REACTOR_H
+#define SCREAM_REACTOR_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hybrid_lock.h"
+#include "msg_queue.h"
+#include "realtime.h"
+
+// Block driven by a Reactor thread instead of its own threads. Calls for a given handler never overlap, they all come
+// from the same I/O thread.
+class IoHandler {
+  public:
+    virtual ~IoHandler() = default;
+
+    // the fd given at registration is readable
+    virtual void onReadable() = 0;
+
+    // messages are waiting in the queue given at registration, take some of them; the reactor calls again as long as
+    // some are left
+    virtual void onQueue() = 0;
+};
+
+// A few I/O threads, each waiting in its own epoll instance on the fds and outbound queues of the handlers it was
+// given, so that many sockets share a couple of threads instead of owning two each. Handlers are spread over the
+// threads by count when added.
+class Reactor {
+  public:
+    static constexpr int MAX_EVENTS = 64;
+
+    Reactor(std::string name, size_t thread_count);
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    // the threads are named after the reactor and numbered, unless the config has a name
+    void start(const ThreadConfig &config = {});
+    void stop();
+
+    // the handler must outlive its registration, the queue consumer is the handler from now on; a handler can be added
+    // again for another fd with no queue, e.g. a timerfd, onReadable() is then called for either
+    bool add(IoHandler *handler, int fd, const std::shared_ptr<MsgQueue> &queue);
+
+    // once it returns, the handler is not called anymore, for none of its fds
+    void remove(IoHandler *handler);
+
+    // once nothing enqueues to the queue of removed handlers anymore, e.g. the blocks feeding it are stopped, their
+    // eventfds are closed and their registrations freed
+    void release(const std::shared_ptr<MsgQueue> &queue);
+
+  private:
+    struct Registration;
+
+    // what an epoll event points to
+    struct Tag {
+        Registration *registration;
+        bool queue;
+    };
+
+    struct Registration {
+        IoHandler *handler;
+        int fd;
+        std::shared_ptr<MsgQueue> queue;
+        // eventfd the queue writes to, kept open until the reactor goes away as a producer may still hold it; -1 without
+        // a queue
+        int notify_fd;
+        size_t worker;
+        std::atomic<bool> active;
+        Tag fd_tag;
+        Tag queue_tag;
+    };
+
+    struct Worker {
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        std::thread thread;
+        size_t handler_count = 0;
+        // event batches handled so far
+        std::atomic<uint64_t> rounds = 0;
+    };
+
+    void loop(Worker &worker);
+    static void notify(int fd);
+
+    std::string name;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<Registration>> registrations;
+    std::atomic<bool> stop_condition = true;
+    HybridLock lock;
+};
+
+#endif // SCREAM_REACTOR_H
@@ -0,0 +1,106 @@
+extern "C" {
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+}
+
+#include <cstring>
+#include <unordered_map>
+
+#include "logger.h"
+#include "msg.h"
+#include "realtime.h"
+
+constexpr size_t THREAD_NAME_SIZE = 15;
+
+bool ThreadConfig::set(const std::string &key, const std::string &val, bool &valid) {
+    valid = true;
+    if (key == "thread_name") {
+        name = val;
+    } else if (key == "cpu_affinity") {
+        cpus.clear();
+        // comma separated cpus or ranges of cpus
+        for (size_t first = 0; first < val.size();) {
+            size_t last = val.find(',', first);
+            last = last == std::string::npos ? val.size() : last;
+            const std::string item = val.substr(first, last - first);
+            const size_t dash = item.find('-');
+            const int low = std::stoi(item.substr(0, dash));
+            const int high = dash == std::string::npos ? low : std::stoi(item.substr(dash + 1));
+            for (int cpu = low; cpu <= high; ++cpu) {
+                cpus.push_back(cpu);
+            }
+            valid &= low >= 0 && low <= high && high < CPU_SETSIZE;
+            first = last + 1;
+        }
+    } else if (key == "sched_policy") {
+        static const std::unordered_map<std::string, int> POLICIES = {
+            {"other", SCHED_OTHER}, {"batch", SCHED_BATCH}, {"idle", SCHED_IDLE}, {"fifo", SCHED_FIFO}, {"rr", SCHED_RR},
+        };
+
+        const auto it = POLICIES.find(val);
+        valid = it != POLICIES.end();
+        policy = valid ? it->second : SCHED_OTHER;
+    } else if (key == "sched_priority") {
+        priority = std::stoi(val);
+    } else if (key == "timer_slack") {
+        timer_slack = std::chrono::nanoseconds(std::stoll(val));
+        valid = timer_slack.count() >= 0;
+    } else if (key == "timer_spin") {
+        timer_spin = std::chrono::microseconds(std::stoll(val));
+        valid = timer_spin.count() >= 0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void ThreadConfig::apply(std::string_view base_name, std::string_view role) const {
+    std::string thread_name(name.empty() ? base_name : name);
+    if (!role.empty()) {
+        thread_name.resize(std::min(thread_name.size(), THREAD_NAME_SIZE - std::min(role.size() + 1, THREAD_NAME_SIZE)));
+        thread_name.erase(thread_name.find_last_not_of(' ') + 1);
+        thread_name += '/';
+        thread_name += role;
+    }
+    thread_name.resize(std::min(thread_name.size(), THREAD_NAME_SIZE));
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        if (const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); error != 0) {
+            logger::log(logger::WARNING, thread_name, ": fail to set cpu affinity -> ", std::strerror(error));
+        }
+    }
+
+    if (policy != SCHED_OTHER || priority != 0) {
+        const sched_param param = {.sched_priority = priority};
+        if (const int error = pthread_setschedparam(pthread_self(), policy, &param); error != 0) {
+            logger::log(logger::WARNING, thread_name, ": fail to set scheduling policy ", policy, " priority ", priority, " -> ",
+                        std::strerror(error));
+        }
+    }
+
+    if (timer_slack.count() > 0 && prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(timer_slack.count()), 0, 0, 0) < 0) {
+        logger::log(logger::WARNING, thread_name, ": fail to set timer slack -> ", std::strerror(errno));
+    }
+}
+
+namespace realtime {
+bool lockMemory(size_t packet_buffers, size_t small_buffers) {
+    const bool locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if (!locked) {
+        logger::log(logger::WARNING, "realtime: fail to lock memory -> ", std::strerror(errno));
+    }
+
+    Msg::Pool::prefault(packet_buffers);
+    Msg::SmallPool::prefault(small_buffers);
+    logger::log(logger::INFO, "realtime: memory ", locked ? "locked" : "not locked", ", ", packet_buffers, " packet and ", small_buffers,
+                " small buffers prefaulted");
+    return locked;
+}
+} // namespace realtime
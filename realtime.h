@@ -0,0 +1,45 @@
+#ifndef SCREAM_REALTIME_H
+#define SCREAM_REALTIME_H
+
+extern "C" {
+#include <sched.h>
+}
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Where and how a thread runs, so that the pacers and input sockets can be kept away from the other load of the host,
+// and how it shows in top or perf.
+struct ThreadConfig {
+    // up to 15 characters are kept, the block name when empty
+    std::string name;
+    // any CPU when empty
+    std::vector<int> cpus;
+    int policy = SCHED_OTHER;
+    // 1 to 99 for SCHED_FIFO and SCHED_RR, 0 otherwise
+    int priority = 0;
+    // how much later than asked the kernel may wake the thread up, to batch wakeups; 0 keeps its default of 50 us for
+    // SCHED_OTHER, real-time threads have none
+    std::chrono::nanoseconds timer_slack{0};
+    // for a Scheduler thread, how long before a timer deadline it stops sleeping and spins instead, 0 for never
+    std::chrono::microseconds timer_spin{0};
+
+    // init() parameters "thread_name", "cpu_affinity" (e.g. "2", "2,3" or "2-5"), "sched_policy" (other, batch, idle,
+    // fifo or rr), "sched_priority", "timer_slack" in ns and "timer_spin" in us; false when the key is not one of
+    // them, valid is false when the value is not
+    bool set(const std::string &key, const std::string &val, bool &valid);
+
+    // on the calling thread, role tells the helper threads of a block apart; failures are logged, e.g. SCHED_FIFO
+    // without CAP_SYS_NICE, and the thread goes on as it is
+    void apply(std::string_view base_name, std::string_view role = {}) const;
+};
+
+namespace realtime {
+// lock the current and future pages of the process in memory and fault in that many pool buffers now, so that neither
+// page faults nor the allocator show up on the packet path
+bool lockMemory(size_t packet_buffers, size_t small_buffers);
+} // namespace realtime
+
+#endif // SCREAM_REALTIME_H
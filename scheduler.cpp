@@ -0,0 +1,354 @@
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+}
+
+#include <array>
+#include <cstring>
+
+#include "logger.h"
+#include "scheduler.h"
+
+namespace {
+// a null tag stands for the wakeup fd, this one for the timerfd
+Task::promise_type *const TIMER_TAG = reinterpret_cast<Task::promise_type *>(1);
+constexpr int MAX_EVENTS = 64;
+} // namespace
+
+void Task::promise_type::unhandled_exception() {
+    try {
+        throw;
+    } catch (const std::exception &e) {
+        logger::log(logger::ERROR, "task: unhandled exception -> ", e.what());
+    } catch (...) {
+        logger::log(logger::ERROR, "task: unhandled exception");
+    }
+}
+
+Task &Task::operator=(Task &&other) noexcept {
+    if (this != &other) {
+        if (handle) {
+            handle.destroy();
+        }
+        handle = std::exchange(other.handle, {});
+    }
+    return *this;
+}
+
+Task::~Task() {
+    // never spawned
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+Scheduler::Scheduler(std::string name) : name(std::move(name)), lock(this->name + " inbox") {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0 || timer_fd < 0) {
+        logger::log(logger::ERROR, this->name, ": fail to create epoll instance -> ", std::strerror(errno));
+    }
+
+    epoll_event wake_event = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_event);
+    epoll_event timer_event = {.events = EPOLLIN, .data = {.ptr = TIMER_TAG}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event);
+}
+
+Scheduler::~Scheduler() {
+    if (!stop_condition.load()) {
+        stop();
+    }
+
+    // tasks still waiting, their blocks were not stopped
+    for (Promise *promise : tasks) {
+        promise->group->running.fetch_sub(1, std::memory_order::release);
+        promise->group->running.notify_all();
+        Task::Handle::from_promise(*promise).destroy();
+    }
+    for (const auto &[queue, fd] : notifiers) {
+        queue->setNotifier(-1);
+        close(fd);
+    }
+    close(epoll_fd);
+    close(wake_fd);
+    close(timer_fd);
+}
+
+void Scheduler::start(const ThreadConfig &config) {
+    if (!stop_condition.load()) {
+        logger::log(logger::INFO, name, ": thread already started");
+        return;
+    }
+
+    timer_spin = config.timer_spin;
+    last_report = Clock::now();
+    stop_condition.store(false);
+    thread = std::thread([this, config] {
+        config.apply(name);
+        run();
+    });
+}
+
+void Scheduler::stop() {
+    if (stop_condition.exchange(true)) {
+        logger::log(logger::INFO, name, ": thread already stopped");
+        return;
+    }
+
+    const uint64_t one = 1;
+    (void)write(wake_fd, &one, sizeof(one));
+    thread.join();
+}
+
+void Scheduler::run() {
+    std::array<epoll_event, MAX_EVENTS> events;
+    std::vector<std::function<void()>> posted;
+    std::vector<Promise *> resumed;
+    while (!stop_condition.load(std::memory_order::relaxed)) {
+        lock.lock();
+        posted.swap(inbox);
+        lock.unlock();
+        for (auto &function : posted) {
+            function();
+        }
+        posted.clear();
+
+        // tasks made ready meanwhile wait for the next round, so that none monopolizes the thread
+        resumed.swap(ready);
+        for (Promise *promise : resumed) {
+            resume(promise);
+        }
+        resumed.clear();
+
+        armTimer();
+        const int count = epoll_wait(epoll_fd, events.data(), MAX_EVENTS, ready.empty() ? -1 : 0);
+        if (count < 0 && errno != EINTR) {
+            logger::log(logger::ERROR, name, ": error while waiting for events -> ", std::strerror(errno));
+        }
+
+        for (int i = 0; i < count; ++i) {
+            auto *promise = static_cast<Promise *>(events[i].data.ptr);
+            if (!promise) {
+                uint64_t value;
+                (void)read(wake_fd, &value, sizeof(value));
+            } else if (promise == TIMER_TAG) {
+                expireTimers();
+            } else if (promise->wait_fd >= 0) {
+                promise->wait_fd = -1;
+                ready.push_back(promise);
+            }
+        }
+    }
+}
+
+void Scheduler::spawn(Task task, Task::Group &group) {
+    Promise *promise = &std::exchange(task.handle, {}).promise();
+    promise->scheduler = this;
+    promise->group = &group;
+    group.running.fetch_add(1, std::memory_order::relaxed);
+    post([this, promise] {
+        tasks.insert(promise);
+        resume(promise);
+    });
+}
+
+void Scheduler::release(const std::shared_ptr<MsgQueue> &queue) {
+    post([this, queue] {
+        if (const auto it = notifiers.find(queue); it != notifiers.end()) {
+            queue->setNotifier(-1);
+            close(it->second);
+            notifiers.erase(it);
+        }
+    });
+}
+
+void Scheduler::stop(Task::Group &group) {
+    group.stopped.store(true);
+    post([this, &group] {
+        for (Promise *promise : tasks) {
+            if (promise->group == &group && (promise->wait_fd >= 0 || promise->scheduled || promise->parked)) {
+                cancelWait(promise);
+                ready.push_back(promise);
+            }
+        }
+    });
+}
+
+void Scheduler::wait(Task::Group &group) {
+    for (size_t running; (running = group.running.load(std::memory_order::acquire)) > 0;) {
+        group.running.wait(running);
+    }
+}
+
+bool Scheduler::FdAwaiter::await_suspend(Task::Handle handle) {
+    promise = &handle.promise();
+    if (promise->group->stopped.load(std::memory_order::relaxed)) {
+        return false;
+    }
+
+    promise->scheduler->waitFd(promise, fd);
+    return true;
+}
+
+bool Scheduler::QueueAwaiter::await_suspend(Task::Handle handle) {
+    promise = &handle.promise();
+    if (promise->group->stopped.load(std::memory_order::relaxed)) {
+        return false;
+    }
+
+    Scheduler &scheduler = *promise->scheduler;
+    auto [it, added] = scheduler.notifiers.try_emplace(queue, -1);
+    if (added) {
+        it->second = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        queue->setNotifier(it->second);
+    }
+
+    // consumed now rather than on resume, the queue is armed again only after this
+    uint64_t value;
+    (void)read(it->second, &value, sizeof(value));
+    if (!queue->arm()) {
+        return false;
+    }
+
+    scheduler.waitFd(promise, it->second);
+    return true;
+}
+
+bool Scheduler::TimerAwaiter::await_suspend(Task::Handle handle) {
+    promise = &handle.promise();
+    if (promise->group->stopped.load(std::memory_order::relaxed) || deadline <= Clock::now()) {
+        return false;
+    }
+
+    promise->scheduler->timers.add(*promise, deadline);
+    return true;
+}
+
+bool Scheduler::AlarmAwaiter::await_suspend(Task::Handle handle) {
+    promise = &handle.promise();
+    alarm.current = deadline;
+    if (promise->group->stopped.load(std::memory_order::relaxed) || deadline <= Clock::now()) {
+        return false;
+    }
+
+    if (deadline == Clock::time_point::max()) {
+        promise->parked = true;
+    } else {
+        promise->scheduler->timers.add(*promise, deadline);
+    }
+    alarm.sleeper = promise;
+    return true;
+}
+
+void Scheduler::Alarm::bringForward(Clock::time_point deadline) {
+    // neither asleep nor already made ready, by its timer or a stop
+    if (!sleeper || deadline >= current || !(sleeper->scheduled || sleeper->parked)) {
+        return;
+    }
+
+    current = deadline;
+    sleeper->parked = false;
+    // an overdue one fires at the next round
+    sleeper->scheduler->timers.add(*sleeper, deadline);
+}
+
+void Scheduler::post(std::function<void()> &&function) {
+    lock.lock();
+    const bool idle = inbox.empty();
+    inbox.push_back(std::move(function));
+    lock.unlock();
+
+    if (idle) {
+        const uint64_t one = 1;
+        (void)write(wake_fd, &one, sizeof(one));
+    }
+}
+
+void Scheduler::resume(Promise *promise) {
+    auto handle = Task::Handle::from_promise(*promise);
+    handle.resume();
+    if (!handle.done()) {
+        return;
+    }
+
+    Task::Group &group = *promise->group;
+    tasks.erase(promise);
+    handle.destroy();
+    group.running.fetch_sub(1, std::memory_order::release);
+    group.running.notify_all();
+}
+
+void Scheduler::waitFd(Promise *promise, int fd) {
+    // one shot, so that an fd nobody waits on anymore does not wake the loop
+    epoll_event event = {.events = EPOLLIN | EPOLLONESHOT, .data = {.ptr = promise}};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0 && (errno != ENOENT || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)) {
+        logger::log(logger::ERROR, name, ": fail to wait on fd ", fd, " -> ", std::strerror(errno));
+    }
+    promise->wait_fd = fd;
+}
+
+void Scheduler::cancelWait(Promise *promise) {
+    if (promise->wait_fd >= 0) {
+        // removed rather than left without events, epoll would still report its errors and hangups; waitFd() adds it
+        // back if it is waited on again
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, promise->wait_fd, nullptr);
+        promise->wait_fd = -1;
+    }
+    promise->parked = false;
+    timers.remove(*promise);
+}
+
+void Scheduler::armTimer() {
+    Clock::time_point deadline = timers.next();
+    if (deadline != Clock::time_point::max()) {
+        deadline -= timer_spin;
+    }
+    if (deadline == timer_deadline) {
+        return;
+    }
+
+    timer_deadline = deadline;
+    itimerspec spec = {};
+    if (deadline != Clock::time_point::max()) {
+        // steady_clock is CLOCK_MONOTONIC, a zero value would disarm the timer
+        const auto since_epoch = std::max(deadline.time_since_epoch(), Clock::duration(1));
+        spec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+        spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch % std::chrono::seconds(1)).count();
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void Scheduler::expireTimers() {
+    uint64_t value;
+    (void)read(timer_fd, &value, sizeof(value));
+    timer_deadline = Clock::time_point::max();
+
+    Clock::time_point now;
+    for (;;) {
+        now = Clock::now();
+        timers.advance(now, [this, now](TimerWheel::Timer &timer) {
+            lateness.record(now - timer.deadline);
+            ready.push_back(static_cast<Promise *>(&timer));
+        });
+
+        // the timerfd fired timer_spin early, the rest of the way is spun unless some task can run meanwhile
+        const Clock::time_point next = timers.next();
+        if (!ready.empty() || next == Clock::time_point::max() || next - now > timer_spin) {
+            break;
+        }
+        while (Clock::now() < next) {
+            __builtin_ia32_pause();
+        }
+    }
+
+    if (now - last_report >= REPORT_PERIOD) {
+        if (const std::string text = lateness.report(); !text.empty()) {
+            logger::log(logger::DEBUG, name, ": timer lateness ", text);
+        }
+        last_report = now;
+    }
+}
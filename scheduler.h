@@ -0,0 +1,206 @@
+#ifndef SCREAM_SCHEDULER_H
+#define SCREAM_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "hybrid_lock.h"
+#include "msg_queue.h"
+#include "realtime.h"
+#include "timer_wheel.h"
+
+class Scheduler;
+
+// Coroutine run by a Scheduler, it starts once spawned and frees itself when done. Inside, it waits with the
+// Scheduler::readable(), Scheduler::messages(), Scheduler::sleepUntil() and Scheduler::Alarm::sleepUntil() awaitables,
+// each of them returning at once with false once the group of the task is stopped. Awaits are better kept out of
+// conditions, GCC 12 miscompiles `while (co_await ...)`, e.g.
+//     while (!stop_condition.load(std::memory_order::relaxed)) {
+//         co_await Scheduler::readable(fd);
+//         ...
+//     }
+class Task {
+  public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // the tasks of a block, stopped and waited for together
+    struct Group {
+        std::atomic<bool> stopped = false;
+        std::atomic<size_t> running = 0;
+    };
+
+    // the promise is the timer node of the task, it sleeps on one deadline at most
+    struct promise_type : TimerWheel::Timer {
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+
+        Scheduler *scheduler = nullptr;
+        Group *group = nullptr;
+        // fd the task is suspended on, if any and not ready
+        int wait_fd = -1;
+        // asleep on an Alarm without deadline, until another task sets one
+        bool parked = false;
+    };
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task &operator=(Task &&other) noexcept;
+    ~Task();
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+  private:
+    friend class Scheduler;
+
+    explicit Task(Handle handle) : handle(handle) {}
+
+    Handle handle;
+};
+
+// One thread resuming many tasks as their fds, queues and timers become ready, so that activities which would each
+// own a thread share one, and the state they touch needs no lock since they never run at the same time. Waits go
+// through an epoll instance, timers through a TimerWheel and a single timerfd set to its next deadline, or timer_spin
+// earlier to spin the rest of the way (see ThreadConfig). How late timers fire is logged every REPORT_PERIOD.
+class Scheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto REPORT_PERIOD = std::chrono::seconds(10);
+
+    explicit Scheduler(std::string name);
+    ~Scheduler();
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // the blocks using the scheduler are stopped before it
+    void start(const ThreadConfig &config = {});
+    void stop();
+
+    // from any thread, the task starts on the scheduler thread
+    void spawn(Task task, Task::Group &group);
+
+    // from any thread, once nothing enqueues to the queue anymore, e.g. the blocks feeding it are stopped, its eventfd is
+    // closed and the scheduler lets it go
+    void release(const std::shared_ptr<MsgQueue> &queue);
+
+    // from any thread, the waits of the tasks in the group return false from now on; wait() for them to end
+    void stop(Task::Group &group);
+    static void wait(Task::Group &group);
+
+    // readable or error on the fd, a single task at a time waits on a given fd
+    static auto readable(int fd) { return FdAwaiter{fd}; }
+
+    // messages in the queue, which the scheduler consumes from now on (it keeps it alive as the notifier is set)
+    static auto messages(const std::shared_ptr<MsgQueue> &queue) { return QueueAwaiter{queue}; }
+
+    static auto sleepUntil(Clock::time_point deadline) { return TimerAwaiter{deadline}; }
+    static auto sleepFor(Clock::duration duration) { return TimerAwaiter{Clock::now() + duration}; }
+
+    // Deadline a task sleeps on that the other tasks of its scheduler may bring forward, e.g. a pacer woken as soon as
+    // new media or feedback lets a packet leave before the deadline it had. Only used from the scheduler thread.
+    class Alarm {
+      public:
+        // max() sleeps until bringForward() sets a deadline
+        auto sleepUntil(Clock::time_point deadline) { return AlarmAwaiter{*this, deadline}; }
+        // the sleeping task, if any, wakes at the deadline at the latest
+        void bringForward(Clock::time_point deadline);
+        // of the last sleep, as brought forward
+        Clock::time_point deadline() const { return current; }
+
+      private:
+        friend class Scheduler;
+
+        Task::promise_type *sleeper = nullptr;
+        Clock::time_point current = Clock::time_point::max();
+    };
+
+    // from when each deadline passed to when the scheduler thread noticed
+    const LatenessHistogram &getTimerLateness() const { return lateness; }
+
+  private:
+    using Promise = Task::promise_type;
+
+    struct Awaiter {
+        bool await_ready() const noexcept { return false; }
+        bool await_resume() const noexcept { return !promise->group->stopped.load(std::memory_order::relaxed); }
+
+        Promise *promise = nullptr;
+    };
+
+    struct FdAwaiter : Awaiter {
+        explicit FdAwaiter(int fd) : fd(fd) {}
+        bool await_suspend(Task::Handle handle);
+
+        int fd;
+    };
+
+    struct QueueAwaiter : Awaiter {
+        explicit QueueAwaiter(const std::shared_ptr<MsgQueue> &queue) : queue(queue) {}
+        bool await_suspend(Task::Handle handle);
+
+        const std::shared_ptr<MsgQueue> &queue;
+    };
+
+    struct TimerAwaiter : Awaiter {
+        explicit TimerAwaiter(Clock::time_point deadline) : deadline(deadline) {}
+        bool await_suspend(Task::Handle handle);
+
+        Clock::time_point deadline;
+    };
+
+    struct AlarmAwaiter : Awaiter {
+        AlarmAwaiter(Alarm &alarm, Clock::time_point deadline) : alarm(alarm), deadline(deadline) {}
+        bool await_suspend(Task::Handle handle);
+        bool await_resume() const noexcept {
+            alarm.sleeper = nullptr;
+            return Awaiter::await_resume();
+        }
+
+        Alarm &alarm;
+        Clock::time_point deadline;
+    };
+
+    void run();
+    void post(std::function<void()> &&function);
+    void resume(Promise *promise);
+    void waitFd(Promise *promise, int fd);
+    void cancelWait(Promise *promise);
+    void armTimer();
+    void expireTimers();
+
+    std::string name;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int timer_fd = -1;
+    std::atomic<bool> stop_condition = true;
+    std::thread thread;
+
+    // only touched by the scheduler thread from here
+    std::unordered_set<Promise *> tasks;
+    std::vector<Promise *> ready;
+    TimerWheel timers;
+    Clock::time_point timer_deadline = Clock::time_point::max();
+    Clock::duration timer_spin{};
+    LatenessHistogram lateness;
+    Clock::time_point last_report;
+    // eventfd given to each queue waited on, kept open as long as the scheduler as producers may hold it
+    std::unordered_map<std::shared_ptr<MsgQueue>, int> notifiers;
+
+    // work posted by other threads
+    HybridLock lock;
+    std::vector<std::function<void()>> inbox;
+};
+
+#endif // SCREAM_SCHEDULER_H
@@ -7,7 +7,9 @@ extern "C" {
 #include <unistd.h>
 }
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 #include <random>
 
@@ -15,9 +17,7 @@ extern "C" {
 #include "scream_client_single.h"
 #include "scream_utils.h"
 
-constexpr uint32_t SSRC = 100;
-
-ScreamClientSingle::ScreamClientSingle(std::string name) : SimpleBlock(std::move(name)), scream(SSRC) {}
+ScreamClientSingle::ScreamClientSingle(std::string name) : CoroutineBlock(name), Sink(std::move(name)) {}
 
 void ScreamClientSingle::init(const std::unordered_map<std::string, std::string> &params) {
     if (!stop_condition.load(std::memory_order::relaxed)) {
@@ -43,8 +43,16 @@ void ScreamClientSingle::init(const std::unordered_map<std::string, std::string>
         case hash("remote_port"sv):
             remote_addr.sin_port = htons(std::stoi(val));
             break;
+        case hash("ssrc"sv):
+            stream_ssrc = static_cast<uint32_t>(std::stoul(val));
+            break;
+        case hash("gro"sv):
+            gro = val == "true" || val == "1";
+            break;
         default:
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
             break;
         }
     }
@@ -59,20 +67,24 @@ void ScreamClientSingle::init(const std::unordered_map<std::string, std::string>
         logger::log(logger::ERROR, name, ": fail to set socket reuse port -> ", std::strerror(errno));
     }
 
-    const timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     constexpr uint8_t set = 0x03;
     if (setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &set, sizeof(set)) < 0) {
         logger::log(logger::ERROR, name, ": fail to set socket recvtos -> ", std::strerror(errno));
     }
 
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        logger::log(logger::ERROR, name, ": fail to set socket timestamps, arrivals are stamped on reading -> ", std::strerror(errno));
+    }
+
     if (bind(fd, (const sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to bind socket -> ", std::strerror(errno));
     }
 
+    if (gro && !udp_offload::enableGro(fd)) {
+        logger::log(logger::WARNING, name, ": fail to enable UDP GRO -> ", std::strerror(errno));
+        gro = false;
+    }
+
     if (connect(fd, (const sockaddr *)(&remote_addr), sizeof(remote_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to connect socket -> ", std::strerror(errno));
     }
@@ -84,15 +96,21 @@ void ScreamClientSingle::init(const std::unordered_map<std::string, std::string>
     logger::log(logger::INFO, name, ": will listen on ", local_ip, ':', ntohs(local_addr.sin_port), " and send data to ", remote_ip, ':',
                 ntohs(remote_addr.sin_port));
 
+    scream.emplace(stream_ssrc);
     initialized = true;
 }
 
-void ScreamClientSingle::run() {
-    std::thread lookup_thread(&ScreamClientSingle::periodicRtcp, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for periodic RTCP");
+std::vector<Task> ScreamClientSingle::tasks() {
+    std::vector<Task> tasks;
+    tasks.push_back(receive());
+    tasks.push_back(periodicRtcp());
+    return tasks;
+}
 
-    alignas(64) uint8_t buffer[UDP_BUFFER_SIZE];
-    iovec rcv_iov = {buffer, sizeof(buffer)};
+Task ScreamClientSingle::receive() {
+    // a coalesced receive takes up to 64 KiB
+    std::vector<uint8_t> buffer(gro ? udp_offload::MAX_COALESCED_SIZE : UDP_BUFFER_SIZE);
+    iovec rcv_iov = {buffer.data(), buffer.size()};
     uint8_t ctrl_buffer[8192];
     msghdr mhdr = {NULL, 0, &rcv_iov, 1, ctrl_buffer, sizeof(ctrl_buffer), 0};
     uint8_t tos = 0;
@@ -103,90 +121,136 @@ void ScreamClientSingle::run() {
 
     int ret;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        ret = recvmsg(fd, &mhdr, 0);
+        // shrunk by the kernel to what the previous datagram carried
+        mhdr.msg_controllen = sizeof(ctrl_buffer);
+        ret = recvmsg(fd, &mhdr, MSG_DONTWAIT);
         if (ret < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
                 std::cerr << name << ": error while reading socket -> " << std::strerror(errno) << std::endl;
             }
+            co_await Scheduler::readable(fd);
             continue;
         }
 
-        if (ret < 8) {
-            continue;
-        }
-
+        uint32_t arrival = 0;
+        bool stamped = false;
         for (cmsghdr *cmhdr = CMSG_FIRSTHDR(&mhdr); cmhdr != nullptr; cmhdr = CMSG_NXTHDR(&mhdr, cmhdr)) {
             if (cmhdr->cmsg_level == IPPROTO_IP && cmhdr->cmsg_type == IP_TOS) {
                 // read the TOS byte in the IP header
                 tos = CMSG_DATA(cmhdr)[0];
                 // logger::log(logger::DEBUG, name, ": tos = ", (int)tos);
+            } else if (cmhdr->cmsg_level == SOL_SOCKET && cmhdr->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec time;
+                std::memcpy(&time, CMSG_DATA(cmhdr), sizeof(time));
+                arrival = toNtp(time);
+                stamped = true;
             }
         }
+        if (!stamped) {
+            arrival = getTimeInNtp();
+        }
+
+        // the packets of a coalesced datagram share its TOS byte, the kernel only merges packets with the same one, and
+        // the timestamp of the first one
+        const size_t size = static_cast<size_t>(ret);
+        const size_t segment_size = gro ? udp_offload::segmentSize(mhdr) : 0;
+        const size_t step = segment_size > 0 ? segment_size : size;
+        for (size_t offset = 0; offset < size; offset += step) {
+            handlePacket(buffer.data() + offset, std::min(step, size - offset), tos, arrival);
+        }
+    }
+}
+
+void ScreamClientSingle::handlePacket(const uint8_t *data, size_t size, uint8_t tos, uint32_t arrival) {
+    // a short segment, e.g. the last one of a coalesced datagram, must not be read past its end
+    if (size < 12) {
+        return;
+    }
 
-        /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
-           | Vers | P | X |  CC  | M |  Type  | seq nb | */
-        const uint8_t version = buffer[0] >> 6;
-        const bool padding = (buffer[0] >> 5) & 0b001;
-        const bool extension = (buffer[0] >> 4) & 0b0001;
-        const uint8_t scrc_count = buffer[0] & 0b00001111;
-
-        const bool marker = buffer[1] >> 7;
-        const uint8_t payload_type = buffer[1] & 0b01111111;
-
-        const uint16_t sequence_number = bswap_16(*reinterpret_cast<const uint16_t *>(buffer + 2));
-        const uint32_t timestamp = bswap_32(*reinterpret_cast<const uint32_t *>(buffer + 4));
-        uint32_t ssrc = bswap_32(*reinterpret_cast<const uint32_t *>(buffer + 8));
-        const size_t header_size =
-            12 + 4 * scrc_count + extension * 4 * bswap_16(*reinterpret_cast<const uint16_t *>(buffer + 12 + 4 * scrc_count + 2));
-
-        /*std::cout << "new rtp packet: "
-        << "version=" << (int)version
-        << ", padding=" << padding
-        << ", extension=" << extension
-        << ", scrc count=" << (int)scrc_count
-        << ", marker=" << marker
-        << ", payload type=" << (int)payload_type
-        << ", sequence number=" << sequence_number
-        << ", timestamp=" << timestamp
-        << ", ssrc =" << ssrc
-        << ", total header ret=" << header_size
-        << std::endl;
-        if (marker) {
-            std::cout << "end of frame!" << std::endl;
-        }*/
-
-        auto msg = std::make_shared<Msg>();
-        msg->type = Msg::RTP_PACKET;
-        msg->data = aligned_alloc(64, ret);
-        std::memcpy(msg->data, buffer, ret);
-        msg->size = ret;
-        forward(msg);
-
-        /*if (rand(rng) < 0.02) {
-            tos |= 0x03;
-        }*/
-
-        lock.lock();
-        scream.receive(getTimeInNtp(), 0, SSRC, ret, sequence_number, tos & 0x03, marker);
-        if ((scream.checkIfFlushAck() || marker) && scream.createStandardizedFeedback(getTimeInNtp(), marker, buffer, ret)) {
-            send(fd, buffer, ret, 0);
+    /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
+       | Vers | P | X |  CC  | M |  Type  | seq nb | */
+    const uint8_t version = data[0] >> 6;
+    const bool padding = (data[0] >> 5) & 0b001;
+    const bool extension = (data[0] >> 4) & 0b0001;
+    const uint8_t scrc_count = data[0] & 0b00001111;
+
+    const bool marker = data[1] >> 7;
+    const uint8_t payload_type = data[1] & 0b01111111;
+
+    const uint16_t sequence_number = bswap_16(*reinterpret_cast<const uint16_t *>(data + 2));
+    const uint32_t timestamp = bswap_32(*reinterpret_cast<const uint32_t *>(data + 4));
+    uint32_t ssrc = bswap_32(*reinterpret_cast<const uint32_t *>(data + 8));
+    size_t header_size = 12 + 4 * scrc_count + extension * 4;
+    if (header_size > size) {
+        return;
+    }
+    // the extension length, in 32-bit words, ends its 4-byte header
+    if (extension) {
+        header_size += 4 * bswap_16(*reinterpret_cast<const uint16_t *>(data + header_size - 2));
+        if (header_size > size) {
+            return;
         }
-        lock.unlock();
     }
+
+    /*std::cout << "new rtp packet: "
+    << "version=" << (int)version
+    << ", padding=" << padding
+    << ", extension=" << extension
+    << ", scrc count=" << (int)scrc_count
+    << ", marker=" << marker
+    << ", payload type=" << (int)payload_type
+    << ", sequence number=" << sequence_number
+    << ", timestamp=" << timestamp
+    << ", ssrc =" << ssrc
+    << ", total header size=" << header_size
+    << std::endl;
+    if (marker) {
+        std::cout << "end of frame!" << std::endl;
+    }*/
+
+    auto msg = Msg::create(Msg::RTP_PACKET, size);
+    std::memcpy(msg->data, data, size);
+    msg->size = static_cast<ssize_t>(size);
+    forward(std::move(msg));
+
+    /*if (rand(rng) < 0.02) {
+        tos |= 0x03;
+    }*/
+
+    // written next to the packet rather than over it, the rest of a coalesced datagram is still to be read
+    uint8_t feedback[UDP_BUFFER_SIZE];
+    int feedback_size;
+    scream->receive(arrival, 0, stream_ssrc, static_cast<int>(size), sequence_number, tos & 0x03, marker);
+    if ((scream->checkIfFlushAck() || marker) && scream->createStandardizedFeedback(getTimeInNtp(), marker, feedback, feedback_size)) {
+        send(fd, feedback, feedback_size, 0);
+    }
+    rtcp.bringForward(rtcpDeadline());
+}
+
+Scheduler::Clock::time_point ScreamClientSingle::rtcpDeadline() {
+    const uint32_t now = getTimeInNtp();
+    if (!scream->isFeedback(now)) {
+        return Scheduler::Clock::time_point::max();
+    }
+    // a tick past the interval, scream compares strictly
+    const auto due = static_cast<int32_t>(scream->getLastFeedbackT() + scream->getRtcpFbInterval() + 1 - now);
+    return Scheduler::Clock::now() + std::chrono::nanoseconds(std::max<int64_t>(due, 0) * 1000000000 / 65536);
 }
 
-void ScreamClientSingle::periodicRtcp() {
-    alignas(64) unsigned char buffer[1536];
+Task ScreamClientSingle::periodicRtcp() {
+    unsigned char buffer[1536];
     int size;
+    bool built = true;
     while (!stop_condition.load(std::memory_order::relaxed)) {
+        // until the next packet when scream had nothing to build feedback of
+        co_await rtcp.sleepUntil(built ? rtcpDeadline() : Scheduler::Clock::time_point::max());
         const uint32_t ntp_time = getTimeInNtp();
-        if (scream.isFeedback(ntp_time) && (scream.checkIfFlushAck() || (ntp_time - scream.getLastFeedbackT() > scream.getRtcpFbInterval()))) {
-            lock.lock();
-            if (scream.createStandardizedFeedback(ntp_time, true, buffer, size)) {
+        built = true;
+        if (scream->isFeedback(ntp_time) && (scream->checkIfFlushAck() || (ntp_time - scream->getLastFeedbackT() > scream->getRtcpFbInterval()))) {
+            built = scream->createStandardizedFeedback(ntp_time, true, buffer, size);
+            if (built) {
                 send(fd, buffer, size, 0);
             }
-            lock.unlock();
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(500));
     }
 }
@@ -1,19 +1,27 @@
 #ifndef SCREAM_SCREAMCLIENTSINGLE_H
 #define SCREAM_SCREAMCLIENTSINGLE_H
 
+#include <optional>
 #include <unordered_map>
 
 #include "scream/code/RtpQueue.h"
 #include "scream/code/ScreamRx.h"
 
-#include "simple_block.h"
+#include "coroutine_block.h"
 #include "sink.h"
 #include "source.h"
-#include "spinlock.h"
-
-class ScreamClientSingle : public SimpleBlock, public Sink, public Source {
+#include "udp_offload.h"
+
+// Receiving and periodic RTCP are two tasks of the same scheduler thread, so they share the ScreamRx state without a
+// lock. The RTCP task sleeps until the feedback interval of scream has passed since the last feedback, or until a
+// packet comes when there is nothing to acknowledge, and each packet brings it forward as the interval shrinks. With
+// "gro", media packets coalesced by the kernel are split back into one RTP packet each. Arrivals are stamped by the
+// kernel as they reach the socket, so that the wakeup latency of the thread stays out of the delay scream sees.
+class ScreamClientSingle : public CoroutineBlock, public Sink, public Source {
   public:
     static constexpr size_t UDP_BUFFER_SIZE = 1472;
+    // of the media stream, unless init() is given an "ssrc", e.g. one per session
+    static constexpr uint32_t DEFAULT_SSRC = 100;
 
     explicit ScreamClientSingle(std::string name);
     ~ScreamClientSingle() override = default;
@@ -21,12 +29,20 @@ class ScreamClientSingle : public SimpleBlock, public Sink, public Source {
     void init(const std::unordered_map<std::string, std::string> &params) override;
 
   private:
-    void run() override;
-    void periodicRtcp();
+    std::vector<Task> tasks() override;
+    Task receive();
+    Task periodicRtcp();
+    // forward a single RTP packet and tell scream about it, arrival in the timebase of getTimeInNtp()
+    void handlePacket(const uint8_t *data, size_t size, uint8_t tos, uint32_t arrival);
+    // when the next periodic feedback is due
+    Scheduler::Clock::time_point rtcpDeadline();
 
     int fd = -1;
-    ScreamRx scream;
-    spinlock lock;
+    uint32_t stream_ssrc = DEFAULT_SSRC;
+    bool gro = false;
+    // made by init(), for the ssrc
+    std::optional<ScreamRx> scream;
+    Scheduler::Alarm rtcp;
 };
 
 #endif // SCREAM_SCREAMCLIENTSINGLE_H
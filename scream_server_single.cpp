@@ -14,10 +14,8 @@ extern "C" {
 #include "scream_server_single.h"
 #include "scream_utils.h"
 
-constexpr uint32_t SSRC = 100;
-
 ScreamServerSingle::ScreamServerSingle(std::string name, bool l4s, bool new_cc)
-    : SimpleBlock(std::forward<std::string>(name)), l4s(l4s),
+    : CoroutineBlock(name), Sink(std::move(name)), l4s(l4s),
       scream(0.9f, 0.9f, 0.06f, false, 1.0f, 10.0f, 12500, 1.25f, 20, l4s, false, false, 2.0f, new_cc) {}
 
 ScreamServerSingle::~ScreamServerSingle() {
@@ -62,8 +60,13 @@ void ScreamServerSingle::init(const std::unordered_map<std::string, std::string>
         case hash("start_bitrate"sv):
             start_bitrate = std::stof(val);
             break;
+        case hash("ssrc"sv):
+            stream_ssrc = static_cast<uint32_t>(std::stoul(val));
+            break;
         default:
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
             break;
         }
     }
@@ -78,11 +81,6 @@ void ScreamServerSingle::init(const std::unordered_map<std::string, std::string>
         logger::log(logger::ERROR, name, ": fail to set socket reuse port -> ", std::strerror(errno));
     }
 
-    const timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     const int ect = l4s ? 1 : 2; // ECN_ECT_0 = 2, ECN_ECT_1 = 1;
     if (setsockopt(fd, IPPROTO_IP, IP_TOS, &ect, sizeof(ect)) < 0) {
         logger::log(logger::ERROR, name, ": fail to set ecn ect bit -> ", std::strerror(errno));
@@ -127,112 +125,126 @@ void ScreamServerSingle::init(const std::unordered_map<std::string, std::string>
         start_bitrate = max_bitrate;
     }
 
-    scream.registerNewStream(&rtp_queue, SSRC, 1.0f, min_bitrate, start_bitrate, max_bitrate, 10e6, 0.5f, 0.2f, 0.1f, 0.05f, 0.9f, 0.9f, false, 0.0f);
+    scream.registerNewStream(&rtp_queue, stream_ssrc, 1.0f, min_bitrate, start_bitrate, max_bitrate, 10e6, 0.5f, 0.2f, 0.1f, 0.05f, 0.9f, 0.9f, false,
+                             0.0f);
     logger::log(logger::INFO, name, ": scream will contain bitrate in the range [", static_cast<uint32_t>(min_bitrate), ", ",
                 static_cast<uint32_t>(max_bitrate), "] with a starting value of ", static_cast<uint32_t>(start_bitrate));
     initialized = true;
 }
 
-void ScreamServerSingle::run() {
-    std::thread lookup_thread(&ScreamServerSingle::lookup, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for lookup operations");
-    std::thread read_thread(&ScreamServerSingle::read, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for read operations");
+std::vector<Task> ScreamServerSingle::tasks() {
+    std::vector<Task> tasks;
+    tasks.push_back(receive());
+    tasks.push_back(pace());
+    tasks.push_back(feedback());
+    return tasks;
+}
 
-    logger::log(logger::DEBUG, name, ": listen thread pid is ", gettid());
-    std::shared_ptr<const Msg> msg;
+Task ScreamServerSingle::receive() {
+    std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (!own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY)) {
+        const size_t count = own_queue->try_dequeue_bulk(msgs.data(), msgs.size());
+        if (count == 0) {
+            co_await Scheduler::messages(own_queue);
             continue;
         }
 
-        if (msg->type != Msg::RTP_PACKET || msg->size < 12) {
-            logger::log(logger::DEBUG, name, ": got unknown message type or message size too small");
-        }
-
-        auto *const rtp_data = static_cast<const uint8_t *const>(msg->data);
-        /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
-           | Vers | P | X |  CC  | M |  Type  | seq nb | */
-        const uint8_t version = rtp_data[0] >> 6;
-        const bool padding = (rtp_data[0] >> 5) & 0b001;
-        const bool extension = (rtp_data[0] >> 4) & 0b0001;
-        const uint8_t scrc_count = rtp_data[0] & 0b00001111;
-
-        const bool marker = rtp_data[1] >> 7;
-        const uint8_t payload_type = rtp_data[1] & 0b01111111;
-
-        const uint16_t sequence_number = ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 2));
-        const uint32_t timestamp = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 4));
-        const uint32_t ssrc = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 8));
-        const size_t header_size =
-            12 + 4 * scrc_count + extension * 4 * ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 12 + 4 * scrc_count + 2));
-
-        /*std::cout << "new rtp packet: "
-        << "version=" << (int)version
-        << ", padding=" << padding
-        << ", extension=" << extension
-        << ", scrc count=" << (int)scrc_count
-        << ", marker=" << marker
-        << ", payload type=" << (int)payload_type
-        << ", sequence number=" << sequence_number
-        << ", timestamp=" << timestamp
-        << ", ssrc=" << ssrc
-        << ", total header size=" << header_size
-        << std::endl;
-        if (marker) {
-            std::cout << "end of frame!" << std::endl;
-        }*/
-
-        void *packet = std::aligned_alloc(64, msg->size);
-        std::memcpy(packet, rtp_data, msg->size);
         const uint32_t time = getTimeInNtp();
+        for (size_t n = 0; n < count; ++n) {
+            MsgPtr msg = std::move(msgs[n]);
+            if (msg->type != Msg::RTP_PACKET || msg->size < 12) {
+                logger::log(logger::DEBUG, name, ": got unknown message type or message size too small");
+            }
 
-        lock.lock();
-        rtp_queue.push(packet, static_cast<int>(msg->size), SSRC, sequence_number, marker, static_cast<const float>(time) / 65536.0f);
-        scream.newMediaFrame(time, SSRC, static_cast<int>(msg->size), marker);
-        lock.unlock();
-    }
+            auto *const rtp_data = static_cast<const uint8_t *const>(msg->data);
+            /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
+               | Vers | P | X |  CC  | M |  Type  | seq nb | */
+            const uint8_t version = rtp_data[0] >> 6;
+            const bool padding = (rtp_data[0] >> 5) & 0b001;
+            const bool extension = (rtp_data[0] >> 4) & 0b0001;
+            const uint8_t scrc_count = rtp_data[0] & 0b00001111;
+
+            const bool marker = rtp_data[1] >> 7;
+            const uint8_t payload_type = rtp_data[1] & 0b01111111;
+
+            const uint16_t sequence_number = ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 2));
+            const uint32_t timestamp = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 4));
+            const uint32_t ssrc = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 8));
+            const size_t header_size =
+                12 + 4 * scrc_count + extension * 4 * ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 12 + 4 * scrc_count + 2));
+
+            /*std::cout << "new rtp packet: "
+            << "version=" << (int)version
+            << ", padding=" << padding
+            << ", extension=" << extension
+            << ", scrc count=" << (int)scrc_count
+            << ", marker=" << marker
+            << ", payload type=" << (int)payload_type
+            << ", sequence number=" << sequence_number
+            << ", timestamp=" << timestamp
+            << ", ssrc=" << ssrc
+            << ", total header size=" << header_size
+            << std::endl;
+            if (marker) {
+                std::cout << "end of frame!" << std::endl;
+            }*/
+
+            const int size = static_cast<int>(msg->size);
+
+            // the rtp queue holds our reference until transmit() sends the packet or scream discards it with packet_free()
+            rtp_queue.push(msg.release(), size, stream_ssrc, sequence_number, marker, static_cast<const float>(time) / 65536.0f);
+            scream.newMediaFrame(time, stream_ssrc, size, marker);
+        }
 
-    lookup_thread.join();
-    read_thread.join();
+        // out now if scream lets them, rather than at the next pacing deadline, and the pacer back by the deadline of
+        // the rest
+        pacer.bringForward(paceDeadline(transmit()));
+    }
 }
 
-void ScreamServerSingle::lookup() {
-    logger::log(logger::DEBUG, name, ": lookup thread pid is ", gettid());
-
+float ScreamServerSingle::transmit() {
     uint32_t ssrc;
     int size;
     uint16_t seq;
     bool is_marked;
     void *data;
-    while (!stop_condition.load(std::memory_order::relaxed)) {
-        const auto start = std::chrono::steady_clock::now();
-        lock.lock();
-        float can_transmit = scream.isOkToTransmit(getTimeInNtp(), ssrc);
-        while (can_transmit == 0 && rtp_queue.sizeOfQueue() > 0) {
-            if (rtp_queue.pop(&data, size, ssrc, seq, is_marked)) {
-                ;
-                send(fd, data, size, 0);
-                can_transmit = scream.addTransmitted(getTimeInNtp(), ssrc, size, seq, is_marked);
-            } else {
-                can_transmit = scream.isOkToTransmit(getTimeInNtp(), ssrc);
-            }
+    float can_transmit = scream.isOkToTransmit(getTimeInNtp(), ssrc);
+    while (can_transmit == 0 && rtp_queue.sizeOfQueue() > 0) {
+        if (rtp_queue.pop(&data, size, ssrc, seq, is_marked)) {
+            MsgPtr packet(static_cast<Msg *>(data));
+            send(fd, packet->data, size, 0);
+            can_transmit = scream.addTransmitted(getTimeInNtp(), ssrc, size, seq, is_marked);
+        } else {
+            can_transmit = scream.isOkToTransmit(getTimeInNtp(), ssrc);
         }
+    }
+    return can_transmit;
+}
 
-        lock.unlock();
-        // std::this_thread::sleep_until(start + std::chrono::duration<float>(can_transmit > 0 ? can_transmit : 500e-6));
-        std::this_thread::sleep_until(start + std::chrono::microseconds(10));
+Scheduler::Clock::time_point ScreamServerSingle::paceDeadline(float can_transmit) {
+    const auto now = Scheduler::Clock::now();
+    if (can_transmit > 0) {
+        return now + std::chrono::duration_cast<Scheduler::Clock::duration>(std::chrono::duration<float>(can_transmit));
     }
+    // new media brings the pacer back, feedback a congestion window it opens
+    return rtp_queue.sizeOfQueue() > 0 ? now + PACE_STALL_PERIOD : Scheduler::Clock::time_point::max();
 }
 
-void ScreamServerSingle::read() {
-    logger::log(logger::DEBUG, name, ": read thread pid is ", gettid());
+Task ScreamServerSingle::pace() {
+    while (!stop_condition.load(std::memory_order::relaxed)) {
+        co_await pacer.sleepUntil(paceDeadline(transmit()));
+    }
+}
 
+Task ScreamServerSingle::feedback() {
     alignas(64) uint8_t buffer[UDP_BUFFER_SIZE];
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        ssize_t size = recv(fd, buffer, UDP_BUFFER_SIZE, 0);
+        // the socket is drained before sleeping on it
+        ssize_t size = recv(fd, buffer, UDP_BUFFER_SIZE, MSG_DONTWAIT);
         if (size < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await Scheduler::readable(fd);
+            } else {
                 std::cerr << name << ": error while reading socket -> " << std::strerror(errno) << std::endl;
             }
             continue;
@@ -248,8 +260,8 @@ void ScreamServerSingle::read() {
         const uint8_t packet_type = buffer[1];
         const uint16_t length = bswap_16(*reinterpret_cast<const uint16_t *>(buffer + 2));
         const uint32_t ssrc = bswap_32(*reinterpret_cast<const uint32_t *>(buffer + 4));
-        if (ssrc != SSRC) {
-            *reinterpret_cast<uint32_t *>(buffer + 4) = SSRC;
+        if (ssrc != stream_ssrc) {
+            *reinterpret_cast<uint32_t *>(buffer + 4) = stream_ssrc;
         }
 
         /*std::cout << "new rtp packet: "
@@ -262,15 +274,14 @@ void ScreamServerSingle::read() {
         << std::endl;*/
 
         const uint32_t time = getTimeInNtp();
-        auto msg = std::make_shared<Msg>();
 
-        lock.lock();
         scream.incomingStandardizedFeedback(time, buffer, static_cast<int>(size));
-        msg->size = static_cast<ssize_t>(scream.getTargetBitrate(SSRC));
-        lock.unlock();
+        const auto bitrate = static_cast<int64_t>(scream.getTargetBitrate(stream_ssrc));
+
+        // acknowledged packets may open the congestion window
+        pacer.bringForward(paceDeadline(transmit()));
 
-        msg->type = msg->size > 0 ? Msg::BITRATE_REQUEST : Msg::IFRAME_REQUEST;
-        forward(msg);
+        forward(Msg::control(bitrate > 0 ? Msg::BITRATE_REQUEST : Msg::IFRAME_REQUEST, bitrate));
 
         if (time - last_log > 2 * 65536) {
             char log[160];
@@ -1,19 +1,24 @@
 #ifndef SCREAM_SCREAMSERVERSINGLE_H
 #define SCREAM_SCREAMSERVERSINGLE_H
 
-#include <thread>
-
 #include "scream/code/RtpQueue.h"
 #include "scream/code/ScreamTx.h"
 
-#include "simple_block.h"
+#include "coroutine_block.h"
 #include "sink.h"
 #include "source.h"
-#include "spinlock.h"
 
-class ScreamServerSingle : public SimpleBlock, public Sink, public Source {
+// Media from the queue, pacing and feedback from the socket are three tasks of the same scheduler thread, so they
+// share the ScreamTx state without a lock. Packets go out as soon as scream lets them: on arrival, on feedback, and at
+// the deadline it asks for, which the pacer sleeps on and the other two bring forward when scream gives them an earlier
+// one. Without a deadline, the pacer sleeps until media comes, or PACE_STALL_PERIOD while media waits on a congestion
+// window that no feedback opens.
+class ScreamServerSingle : public CoroutineBlock, public Sink, public Source {
   public:
     static constexpr size_t UDP_BUFFER_SIZE = 1472;
+    // of the media stream, unless init() is given an "ssrc", e.g. one per session
+    static constexpr uint32_t DEFAULT_SSRC = 100;
+    static constexpr auto PACE_STALL_PERIOD = std::chrono::milliseconds(5);
 
     explicit ScreamServerSingle(std::string name, bool l4s = false, bool new_cc = false);
     ~ScreamServerSingle() override;
@@ -21,16 +26,22 @@ class ScreamServerSingle : public SimpleBlock, public Sink, public Source {
     void init(const std::unordered_map<std::string, std::string> &params) override;
 
   private:
-    void run() override;
-    void lookup();
-    void read();
+    std::vector<Task> tasks() override;
+    Task receive();
+    Task pace();
+    Task feedback();
+    // send what scream lets through now, return the seconds until it lets more through, or not positive for unknown
+    float transmit();
+    // when the pacer is to ask scream again, given what transmit() returned
+    Scheduler::Clock::time_point paceDeadline(float can_transmit);
 
     int fd = -1;
+    uint32_t stream_ssrc = DEFAULT_SSRC;
     bool l4s;
+    Scheduler::Alarm pacer;
     ScreamV1Tx scream;
     RtpQueue rtp_queue;
     uint32_t last_log = 0;
-    spinlock lock;
 };
 
 #endif // SCREAM_SCREAMSERVERSINGLE_H
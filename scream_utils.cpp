@@ -5,10 +5,12 @@ extern "C" {
 #include <cstdlib>
 
 #include "scream_utils.h"
+#include "source.h"
 
 double t0 = 0;
 
-void packet_free(void *buf, uint32_t ssrc) { free(buf); }
+// packets in scream's RtpQueue are references on Msg given away with MsgPtr::release()
+void packet_free(void *buf, uint32_t ssrc) { MsgPtr packet(static_cast<Msg *>(buf)); }
 
 uint32_t getTimeInNtp() {
     timeval tp;
@@ -19,6 +21,12 @@ uint32_t getTimeInNtp() {
     return ntp;
 }
 
+uint32_t toNtp(const timespec &time) {
+    const double seconds = time.tv_sec + time.tv_nsec * 1e-9 - t0;
+    const auto ntp64 = static_cast<uint64_t>(seconds * 65536.0);
+    return 0xFFFFFFFF & ntp64;
+}
+
 void initT0() {
     struct timeval tp;
     gettimeofday(&tp, NULL);
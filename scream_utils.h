@@ -1,12 +1,19 @@
 #ifndef SCREAM_SCREAM_UTILS_H
 #define SCREAM_SCREAM_UTILS_H
 
+extern "C" {
+#include <time.h>
+}
+
 #include <cstdint>
 
 void packet_free(void *buf, uint32_t ssrc);
 
 uint32_t getTimeInNtp();
 
+// a CLOCK_REALTIME time, e.g. a kernel receive timestamp, in the timebase of getTimeInNtp()
+uint32_t toNtp(const timespec &time);
+
 void initT0();
 
 #endif // SCREAM_SCREAM_UTILS_H
@@ -1,23 +1,26 @@
 extern "C" {
 #include <arpa/inet.h>
 #include <byteswap.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 }
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
 #include "logger.h"
 #include "scream_utils.h"
 #include "scream_v2_server_single.h"
 
-constexpr uint32_t SSRC = 100;
-
 ScreamV2ServerSingle::ScreamV2ServerSingle(std::string name, bool l4s)
-    : SimpleBlock(std::move(name)), l4s(l4s), scream(0.7f, 0.7f, 0.06f, 12500, 1.5f, 1.5f, 2.0f, 0.05f, l4s, false, false, false) {}
+    : CoroutineBlock(name), Sink(std::move(name)), l4s(l4s), scream(0.7f, 0.7f, 0.06f, 12500, 1.5f, 1.5f, 2.0f, 0.05f, l4s, false, false, false) {}
 
 ScreamV2ServerSingle::~ScreamV2ServerSingle() {
     if (fd >= 0) {
@@ -61,8 +64,25 @@ void ScreamV2ServerSingle::init(const std::unordered_map<std::string, std::strin
         case hash("start_bitrate"sv):
             start_bitrate = std::stof(val);
             break;
+        case hash("ssrc"sv):
+            stream_ssrc = static_cast<uint32_t>(std::stoul(val));
+            break;
+        case hash("gso"sv):
+            gso = val == "true" || val == "1";
+            break;
+        case hash("txtime"sv):
+            txtime = val == "true" || val == "1";
+            break;
+        case hash("txtime_clock"sv):
+            txtime_clock = val == "tai" ? CLOCK_TAI : CLOCK_MONOTONIC;
+            break;
+        case hash("txtime_horizon"sv):
+            txtime_horizon = std::chrono::microseconds(std::stoul(val));
+            break;
         default:
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
             break;
         }
     }
@@ -77,20 +97,39 @@ void ScreamV2ServerSingle::init(const std::unordered_map<std::string, std::strin
         logger::log(logger::ERROR, name, ": fail to set socket reuse port -> ", std::strerror(errno));
     }
 
-    const timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     const int ect = l4s ? 1 : 2; // ECN_ECT_0 = 2, ECN_ECT_1 = 1;
     if (setsockopt(fd, IPPROTO_IP, IP_TOS, &ect, sizeof(ect)) < 0) {
         logger::log(logger::ERROR, name, ": fail to set ecn ect bit -> ", std::strerror(errno));
     }
 
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        logger::log(logger::ERROR, name, ": fail to set socket timestamps, feedback is stamped on reading -> ", std::strerror(errno));
+    }
+
     if (bind(fd, (const sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to bind socket -> ", std::strerror(errno));
     }
 
+    if (gso && !udp_offload::gsoSupported(fd)) {
+        logger::log(logger::WARNING, name, ": no UDP GSO in this kernel, sending packets one by one");
+        gso = false;
+    }
+
+    // missed departures come back on the error queue
+    const sock_txtime txtime_config = {.clockid = txtime_clock, .flags = SOF_TXTIME_REPORT_ERRORS};
+    if (txtime && setsockopt(fd, SOL_SOCKET, SO_TXTIME, &txtime_config, sizeof(txtime_config)) < 0) {
+        logger::log(logger::WARNING, name, ": fail to set socket txtime, pacing in user space -> ", std::strerror(errno));
+        txtime = false;
+    }
+
+    // software stamps of the packets leaving the qdisc, numbered by send, without the payload back
+    const int timestamping = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    tx_timestamps = txtime && setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping)) == 0;
+    if (txtime && !tx_timestamps) {
+        logger::log(logger::WARNING, name, ": fail to set transmit timestamps, departures are not measured -> ", std::strerror(errno));
+    }
+    tx_sends = 0;
+
     if (connect(fd, (const sockaddr *)(&remote_addr), sizeof(remote_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to connect socket -> ", std::strerror(errno));
     }
@@ -126,7 +165,7 @@ void ScreamV2ServerSingle::init(const std::unordered_map<std::string, std::strin
         start_bitrate = max_bitrate;
     }
 
-    scream.registerNewStream(&rtp_queue, SSRC, 1.0f, min_bitrate, start_bitrate, max_bitrate, 0.2f, false, 0.0f);
+    scream.registerNewStream(&rtp_queue, stream_ssrc, 1.0f, min_bitrate, start_bitrate, max_bitrate, 0.2f, false, 0.0f);
     logger::log(logger::INFO, name, ": scream will contain bitrate in the range [", static_cast<uint32_t>(min_bitrate), ", ",
                 static_cast<uint32_t>(max_bitrate), "] with a starting value of ", static_cast<uint32_t>(start_bitrate));
     /*static FILE *file = fopen("log.txt", "w");
@@ -134,106 +173,272 @@ void ScreamV2ServerSingle::init(const std::unordered_map<std::string, std::strin
     initialized = true;
 }
 
-void ScreamV2ServerSingle::run() {
-    std::thread lookup_thread(&ScreamV2ServerSingle::lookup, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for lookup operations");
-    std::thread read_thread(&ScreamV2ServerSingle::read, this);
-    logger::log(logger::INFO, name, ": spawn an additional thread for read operations");
+std::vector<Task> ScreamV2ServerSingle::tasks() {
+    std::vector<Task> tasks;
+    tasks.push_back(receive());
+    tasks.push_back(pace());
+    tasks.push_back(feedback());
+    return tasks;
+}
 
-    logger::log(logger::DEBUG, name, ": listen thread pid is ", gettid());
-    std::shared_ptr<const Msg> msg;
+Task ScreamV2ServerSingle::receive() {
+    std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (!own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY)) {
+        const size_t count = own_queue->try_dequeue_bulk(msgs.data(), msgs.size());
+        if (count == 0) {
+            co_await Scheduler::messages(own_queue);
             continue;
         }
 
-        if (msg->type != Msg::RTP_PACKET || msg->size < 12) {
-            logger::log(logger::DEBUG, name, ": got unknown message type or message size too small");
-        }
-
-        auto *const rtp_data = static_cast<const uint8_t *const>(msg->data);
-        /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
-           | Vers | P | X |  CC  | M |  Type  | seq nb | */
-        const uint8_t version = rtp_data[0] >> 6;
-        const bool padding = (rtp_data[0] >> 5) & 0b001;
-        const bool extension = (rtp_data[0] >> 4) & 0b0001;
-        const uint8_t scrc_count = rtp_data[0] & 0b00001111;
-
-        const bool marker = rtp_data[1] >> 7;
-        const uint8_t payload_type = rtp_data[1] & 0b01111111;
-
-        const uint16_t sequence_number = ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 2));
-        const uint32_t timestamp = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 4));
-        const uint32_t ssrc = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 8));
-        const size_t header_size =
-            12 + 4 * scrc_count + extension * 4 * ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 12 + 4 * scrc_count + 2));
-
-        /*std::cout << "new rtp packet: "
-        << "version=" << (int)version
-        << ", padding=" << padding
-        << ", extension=" << extension
-        << ", scrc count=" << (int)scrc_count
-        << ", marker=" << marker
-        << ", payload type=" << (int)payload_type
-        << ", sequence number=" << sequence_number
-        << ", timestamp=" << timestamp
-        << ", ssrc=" << ssrc
-        << ", total header size=" << header_size
-        << std::endl;
-        if (marker) {
-            std::cout << "end of frame!" << std::endl;
-        }*/
-
-        void *packet = std::aligned_alloc(64, msg->size);
-        std::memcpy(packet, rtp_data, msg->size);
         const uint32_t time = getTimeInNtp();
+        for (size_t n = 0; n < count; ++n) {
+            MsgPtr msg = std::move(msgs[n]);
+            if (msg->type != Msg::RTP_PACKET || msg->size < 12) {
+                logger::log(logger::DEBUG, name, ": got unknown message type or message size too small");
+            }
 
-        lock.lock();
-        rtp_queue.push(packet, static_cast<int>(msg->size), SSRC, sequence_number, marker, static_cast<float>(time) / 65536.0f);
-        scream.newMediaFrame(time, SSRC, static_cast<int>(msg->size), marker);
-        lock.unlock();
-    }
+            auto *const rtp_data = static_cast<const uint8_t *const>(msg->data);
+            /* |-0--2-|-3-|-4-|-5--8-|-9-|-10--16-|-17--31-| (bits)
+               | Vers | P | X |  CC  | M |  Type  | seq nb | */
+            const uint8_t version = rtp_data[0] >> 6;
+            const bool padding = (rtp_data[0] >> 5) & 0b001;
+            const bool extension = (rtp_data[0] >> 4) & 0b0001;
+            const uint8_t scrc_count = rtp_data[0] & 0b00001111;
+
+            const bool marker = rtp_data[1] >> 7;
+            const uint8_t payload_type = rtp_data[1] & 0b01111111;
+
+            const uint16_t sequence_number = ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 2));
+            const uint32_t timestamp = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 4));
+            const uint32_t ssrc = ntohl(*reinterpret_cast<const uint32_t *>(rtp_data + 8));
+            const size_t header_size =
+                12 + 4 * scrc_count + extension * 4 * ntohs(*reinterpret_cast<const uint16_t *>(rtp_data + 12 + 4 * scrc_count + 2));
+
+            /*std::cout << "new rtp packet: "
+            << "version=" << (int)version
+            << ", padding=" << padding
+            << ", extension=" << extension
+            << ", scrc count=" << (int)scrc_count
+            << ", marker=" << marker
+            << ", payload type=" << (int)payload_type
+            << ", sequence number=" << sequence_number
+            << ", timestamp=" << timestamp
+            << ", ssrc=" << ssrc
+            << ", total header size=" << header_size
+            << std::endl;
+            if (marker) {
+                std::cout << "end of frame!" << std::endl;
+            }*/
+
+            const int size = static_cast<int>(msg->size);
+
+            // the rtp queue holds our reference until transmit() sends the packet or scream discards it with packet_free()
+            rtp_queue.push(msg.release(), size, stream_ssrc, sequence_number, marker, static_cast<float>(time) / 65536.0f);
+            scream.newMediaFrame(time, stream_ssrc, size, marker);
+        }
 
-    lookup_thread.join();
-    read_thread.join();
+        // out now if scream lets them, rather than at the next pacing deadline, and the pacer back by the deadline of
+        // the rest
+        pacer.bringForward(paceDeadline(transmit()));
+    }
 }
 
-void ScreamV2ServerSingle::lookup() {
-    logger::log(logger::DEBUG, name, ": lookup thread pid is ", gettid());
-
+float ScreamV2ServerSingle::transmit() {
     uint32_t ssrc;
     int size;
     uint16_t seq;
     bool is_marked;
     void *data;
-    while (!stop_condition.load(std::memory_order::relaxed)) {
-        lock.lock();
-        float can_transmit = scream.isOkToTransmit(getTimeInNtp(), ssrc);
-        size_t rtp_queue_size = rtp_queue.sizeOfQueue();
-        lock.unlock();
-        while (can_transmit == 0 && rtp_queue_size > 0) {
-            lock.lock();
-            rtp_queue.pop(&data, size, ssrc, seq, is_marked); // as per rtpqueue sendpacket function
-            send(fd, data, size, 0);
-            can_transmit = scream.addTransmitted(getTimeInNtp(), ssrc, size, seq, is_marked);
-            rtp_queue_size = rtp_queue.sizeOfQueue();
-            lock.unlock();
-            free(data);
+    // scream is only ever given the current time, the packets it lets through go now; with txtime, a pacing wait ending
+    // within the horizon is left to the qdisc instead: the packet is handed over too, with a departure time that much
+    // after the previous one, and scream counts it as sent now
+    const uint32_t now = getTimeInNtp();
+    const auto horizon = static_cast<uint32_t>(txtime ? txtime_horizon.count() * 65536 / 1000000 : 0);
+    uint32_t departure = txtime && static_cast<int32_t>(next_departure - now) > 0 ? next_departure : now;
+    timespec clock_now = {};
+    if (txtime) {
+        timespec realtime_now;
+        clock_gettime(txtime_clock, &clock_now);
+        clock_gettime(CLOCK_REALTIME, &realtime_now);
+        realtime_offset = (realtime_now.tv_sec - clock_now.tv_sec) * 1000000000ll + (realtime_now.tv_nsec - clock_now.tv_nsec);
+    }
+
+    float can_transmit = scream.isOkToTransmit(now, ssrc);
+    while (rtp_queue.sizeOfQueue() > 0 && (can_transmit == 0 || (txtime && can_transmit > 0 && departure - now <= horizon))) {
+        rtp_queue.pop(&data, size, ssrc, seq, is_marked); // as per rtpqueue sendpacket function
+        MsgPtr packet(static_cast<Msg *>(data));
+        if (!gso && !txtime) {
+            send(fd, packet->data, size, 0);
+        } else {
+            // a train takes packets leaving together as long as its first one, the last one may be shorter
+            const uint64_t departure_ns = txtime ? clock_now.tv_sec * 1000000000ull + clock_now.tv_nsec +
+                                                       static_cast<uint64_t>(departure - now) * 1000000000ull / 65536
+                                                 : 0;
+            const ssize_t segment_size = train_length > 0 ? train[0]->size : 0;
+            if (train_length > 0 && (!gso || departure_ns != train_departure || train_length == train.size() ||
+                                     train[train_length - 1]->size != segment_size || packet->size > segment_size)) {
+                sendTrain();
+            }
+            train_departure = departure_ns;
+            train[train_length++] = std::move(packet);
+        }
+        can_transmit = scream.addTransmitted(now, ssrc, size, seq, is_marked);
+        if (txtime && can_transmit > 0) {
+            departure += std::max<uint32_t>(static_cast<uint32_t>(can_transmit * 65536.0f), 1);
+            // still asked, at the current time, so that a full congestion window stops the handovers ahead
+            if (scream.isOkToTransmit(now, ssrc) < 0) {
+                can_transmit = -1;
+            }
         }
+    }
+    // the train leaves before the next pacing decision
+    if (train_length > 0) {
+        sendTrain();
+    }
+    next_departure = departure;
 
-        std::this_thread::sleep_for(std::chrono::duration<float>(std::max(can_transmit, 10e-6f)));
-        // std::this_thread::sleep_for(std::chrono::microseconds(10));
+    // back when the next departure enters the horizon, new media calls in by itself
+    if (txtime && can_transmit > 0 && rtp_queue.sizeOfQueue() > 0) {
+        return std::max(static_cast<float>(static_cast<int32_t>(departure - now - horizon)) / 65536.0f, 1e-6f);
+    }
+    return can_transmit;
+}
+
+void ScreamV2ServerSingle::sendTrain() {
+    std::array<iovec, udp_offload::MAX_SEGMENTS> iovs;
+    for (size_t i = 0; i < train_length; ++i) {
+        iovs[i] = {train[i]->data, static_cast<size_t>(train[i]->size)};
+    }
+    msghdr header = {};
+    header.msg_iov = iovs.data();
+    header.msg_iovlen = train_length;
+
+    alignas(cmsghdr) std::array<uint8_t, udp_offload::CONTROL_SIZE + CMSG_SPACE(sizeof(uint64_t))> control = {};
+    size_t control_size = 0;
+    auto append = [&control, &control_size](int level, int type, const void *value, size_t size) {
+        auto *cmhdr = reinterpret_cast<cmsghdr *>(control.data() + control_size);
+        cmhdr->cmsg_level = level;
+        cmhdr->cmsg_type = type;
+        cmhdr->cmsg_len = CMSG_LEN(size);
+        std::memcpy(CMSG_DATA(cmhdr), value, size);
+        control_size += CMSG_SPACE(size);
+    };
+    if (train_length > 1) {
+        const auto segment_size = static_cast<uint16_t>(iovs[0].iov_len);
+        append(SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size));
     }
+    if (txtime) {
+        append(SOL_SOCKET, SCM_TXTIME, &train_departure, sizeof(train_departure));
+    }
+    header.msg_control = control_size > 0 ? control.data() : nullptr;
+    header.msg_controllen = control_size;
+
+    if (sendmsg(fd, &header, 0) < 0) {
+        logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
+        // the device cannot segment, e.g. without checksum offload
+        if (errno == EIO && train_length > 1) {
+            logger::log(logger::WARNING, name, ": UDP GSO refused, sending packets one by one");
+            gso = false;
+        }
+    } else if (tx_timestamps) {
+        // a train is one send, stamped once
+        tx_departures[tx_sends++ % TX_REPORT_SLOTS] = static_cast<int64_t>(train_departure) + realtime_offset;
+    }
+    for (size_t i = 0; i < train_length; ++i) {
+        train[i].reset();
+    }
+    train_length = 0;
 }
 
-void ScreamV2ServerSingle::read() {
-    logger::log(logger::DEBUG, name, ": read thread pid is ", gettid());
+void ScreamV2ServerSingle::drainErrors() {
+    uint8_t buffer[UDP_BUFFER_SIZE];
+    iovec iov = {buffer, sizeof(buffer)};
+    // SO_TIMESTAMPNS adds its own stamp to the transmit timestamps
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(scm_timestamping)) +
+                                     CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in))];
+    msghdr header = {};
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    for (;;) {
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &header, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+        }
+        if (header.msg_flags & MSG_CTRUNC) {
+            continue;
+        }
+        const timespec *stamp = nullptr;
+        sock_extended_err error = {};
+        for (cmsghdr *cmhdr = CMSG_FIRSTHDR(&header); cmhdr != nullptr; cmhdr = CMSG_NXTHDR(&header, cmhdr)) {
+            if (cmhdr->cmsg_level == SOL_SOCKET && cmhdr->cmsg_type == SCM_TIMESTAMPING) {
+                // software stamp first, then the deprecated and the hardware ones
+                stamp = reinterpret_cast<const timespec *>(CMSG_DATA(cmhdr));
+            } else if (cmhdr->cmsg_level == SOL_IP && cmhdr->cmsg_type == IP_RECVERR) {
+                std::memcpy(&error, CMSG_DATA(cmhdr), sizeof(error));
+            }
+        }
 
+        if (error.ee_origin == SO_EE_ORIGIN_TXTIME) {
+            ++txtime_missed;
+        } else if (error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && stamp && tx_sends - error.ee_data <= TX_REPORT_SLOTS) {
+            timespec left;
+            std::memcpy(&left, stamp, sizeof(left));
+            // late when positive, early, e.g. without an fq or etf qdisc, when negative
+            const int64_t departure_error = left.tv_sec * 1000000000ll + left.tv_nsec - tx_departures[error.ee_data % TX_REPORT_SLOTS];
+            departure_error_sum += departure_error;
+            departure_error_max = std::max<uint64_t>(departure_error_max, static_cast<uint64_t>(std::abs(departure_error)));
+            ++departure_error_count;
+        }
+    }
+}
+
+Scheduler::Clock::time_point ScreamV2ServerSingle::paceDeadline(float can_transmit) {
+    const auto now = Scheduler::Clock::now();
+    if (can_transmit > 0) {
+        return now + std::chrono::duration_cast<Scheduler::Clock::duration>(std::chrono::duration<float>(can_transmit));
+    }
+    // new media brings the pacer back, feedback a congestion window it opens
+    return rtp_queue.sizeOfQueue() > 0 ? now + PACE_STALL_PERIOD : Scheduler::Clock::time_point::max();
+}
+
+Task ScreamV2ServerSingle::pace() {
+    while (!stop_condition.load(std::memory_order::relaxed)) {
+        co_await pacer.sleepUntil(paceDeadline(transmit()));
+
+        // against the deadline as brought forward by the other tasks, without txtime it is when the packets leave
+        const auto deadline = pacer.deadline();
+        const auto now = Scheduler::Clock::now();
+        if (deadline != Scheduler::Clock::time_point::max() && now >= deadline) {
+            const auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+            lateness_sum += lateness;
+            lateness_max = std::max<uint64_t>(lateness_max, lateness);
+            ++lateness_count;
+        }
+    }
+}
+
+Task ScreamV2ServerSingle::feedback() {
     alignas(64) uint8_t buffer[UDP_BUFFER_SIZE];
+    iovec iov = {buffer, sizeof(buffer)};
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(timespec))];
+    msghdr header = {};
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    uint32_t max_delay = 0;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        ssize_t size = recv(fd, buffer, UDP_BUFFER_SIZE, 0);
+        // the socket is drained before sleeping on it
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        ssize_t size = recvmsg(fd, &header, MSG_DONTWAIT);
         if (size < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // a pending error queue keeps the socket readable
+                if (txtime) {
+                    drainErrors();
+                }
+                co_await Scheduler::readable(fd);
+            } else {
                 std::cerr << name << ": error while reading socket -> " << std::strerror(errno) << std::endl;
             }
             continue;
@@ -249,8 +454,8 @@ void ScreamV2ServerSingle::read() {
         const uint8_t packet_type = buffer[1];
         const uint16_t length = bswap_16(*reinterpret_cast<const uint16_t *>(buffer + 2));
         const uint32_t ssrc = bswap_32(*reinterpret_cast<const uint32_t *>(buffer + 4));
-        if (ssrc != SSRC) {
-            *reinterpret_cast<uint32_t *>(buffer + 4) = SSRC;
+        if (ssrc != stream_ssrc) {
+            *reinterpret_cast<uint32_t *>(buffer + 4) = stream_ssrc;
         }
 
         /*std::cout << "new rtp packet: "
@@ -262,26 +467,51 @@ void ScreamV2ServerSingle::read() {
         << ", ssrc=" << ssrc
         << std::endl;*/
 
-        const uint32_t time = getTimeInNtp();
-        auto msg = std::make_shared<Msg>();
+        // stamped by the kernel on arrival, so that the wakeup latency of the thread does not show as queuing delay
+        const uint32_t now = getTimeInNtp();
+        uint32_t time = now;
+        for (cmsghdr *cmhdr = CMSG_FIRSTHDR(&header); cmhdr != nullptr; cmhdr = CMSG_NXTHDR(&header, cmhdr)) {
+            if (cmhdr->cmsg_level == SOL_SOCKET && cmhdr->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec arrival;
+                std::memcpy(&arrival, CMSG_DATA(cmhdr), sizeof(arrival));
+                time = toNtp(arrival);
+            }
+        }
+        max_delay = std::max(max_delay, now - time);
 
-        lock.lock();
         scream.incomingStandardizedFeedback(time, buffer, static_cast<int>(size));
-        msg->size = static_cast<ssize_t>(scream.getTargetBitrate(SSRC));
-        if (msg->size <= 0) {
-            msg->size = static_cast<ssize_t>(scream.getTargetBitrate(SSRC));
+        auto bitrate = static_cast<int64_t>(scream.getTargetBitrate(stream_ssrc));
+        if (bitrate <= 0) {
+            bitrate = static_cast<int64_t>(scream.getTargetBitrate(stream_ssrc));
         }
-        lock.unlock();
 
-        // msg->type = msg->size > 0 ? Msg::BITRATE_REQUEST : Msg::IFRAME_REQUEST;
-        msg->type = Msg::BITRATE_REQUEST;
-        forward(msg);
+        // acknowledged packets may open the congestion window
+        pacer.bringForward(paceDeadline(transmit()));
+
+        // forward(Msg::control(bitrate > 0 ? Msg::BITRATE_REQUEST : Msg::IFRAME_REQUEST, bitrate));
+        forward(Msg::control(Msg::BITRATE_REQUEST, bitrate));
 
         if (time - last_log > 2 * 65536) {
             char log[160];
             scream.getStatistics(static_cast<float>(time) / 65536.0f, log);
-            logger::log(logger::INFO, name, ':', log);
+            std::string departures;
+            if (tx_timestamps) {
+                const int64_t average = departure_error_count > 0 ? departure_error_sum / static_cast<int64_t>(departure_error_count) : 0;
+                departures =
+                    ", departure error avg=" + std::to_string(average / 1000) + "us max=" + std::to_string(departure_error_max / 1000) + "us";
+            }
+            logger::log(logger::INFO, name, ':', log, ", max feedback wakeup delay=", static_cast<uint64_t>(max_delay) * 1000000 / 65536,
+                        "us, pacer lateness avg=", lateness_count > 0 ? lateness_sum / lateness_count : 0, "us max=", lateness_max, "us",
+                        txtime ? ", txtime missed=" : "", txtime ? std::to_string(txtime_missed) : "", departures);
             last_log = time;
+            max_delay = 0;
+            lateness_sum = 0;
+            lateness_max = 0;
+            lateness_count = 0;
+            txtime_missed = 0;
+            departure_error_sum = 0;
+            departure_error_max = 0;
+            departure_error_count = 0;
         }
     }
 }
@@ -1,19 +1,40 @@
 #ifndef SCREAM_SCREAMSERVERSINGLEV2_H
 #define SCREAM_SCREAMSERVERSINGLEV2_H
 
-#include <thread>
+extern "C" {
+#include <time.h>
+}
+
+#include <array>
 
 #include "scream/code/RtpQueue.h"
 #include "scream/code/ScreamTx.h"
 
-#include "simple_block.h"
+#include "coroutine_block.h"
 #include "sink.h"
 #include "source.h"
-#include "spinlock.h"
+#include "udp_offload.h"
 
-class ScreamV2ServerSingle : public SimpleBlock, public Sink, public Source {
+// Media from the queue, pacing and feedback from the socket are three tasks of the same scheduler thread, so they share
+// the ScreamTx state without a lock. Packets go out as soon as scream lets them: on arrival, on feedback, and at the
+// deadline it asks for, which the pacer sleeps on and the other two bring forward when scream gives them an earlier
+// one. Without a deadline, the pacer sleeps until media comes, or PACE_STALL_PERIOD while media waits on a congestion
+// window that no feedback opens. With "gso", the same size packets scream lets through at once leave as one GSO train,
+// so a train never holds more than the pacer allows at that instant. With "txtime", the pacer hands over every packet
+// due within "txtime_horizon" (in us) at once, and the fq or etf qdisc holds each back until its departure time
+// (SO_TXTIME). Scream stays on the real clock: it is told the time a packet is handed over, and the pacing wait it
+// answers spaces the departure times instead of the pacer wakeups. The departure clock is "txtime_clock", monotonic for
+// fq (the default) or tai for etf. The kernel stamps each send as it leaves the qdisc (SO_TIMESTAMPING), and how far
+// that is from the departure asked is logged with the statistics.
+class ScreamV2ServerSingle : public CoroutineBlock, public Sink, public Source {
   public:
     static constexpr size_t UDP_BUFFER_SIZE = 1472;
+    // of the media stream, unless init() is given an "ssrc", e.g. one per session
+    static constexpr uint32_t DEFAULT_SSRC = 100;
+    static constexpr auto PACE_STALL_PERIOD = std::chrono::milliseconds(5);
+    static constexpr auto DEFAULT_TXTIME_HORIZON = std::chrono::microseconds(1000);
+    // sends whose departure time is kept until their transmit timestamp comes back
+    static constexpr size_t TX_REPORT_SLOTS = 256;
 
     explicit ScreamV2ServerSingle(std::string name, bool l4s = false);
     ~ScreamV2ServerSingle() override;
@@ -21,16 +42,51 @@ class ScreamV2ServerSingle : public SimpleBlock, public Sink, public Source {
     void init(const std::unordered_map<std::string, std::string> &params) override;
 
   private:
-    void run() override;
-    void lookup();
-    void read();
+    std::vector<Task> tasks() override;
+    Task receive();
+    Task pace();
+    Task feedback();
+    // send what scream lets through now, return the seconds until it lets more through, or not positive for unknown
+    float transmit();
+    // when the pacer is to ask scream again, given what transmit() returned
+    Scheduler::Clock::time_point paceDeadline(float can_transmit);
+    // the packets of the train as one GSO send, or a single datagram, with their departure time when pacing with txtime
+    void sendTrain();
+    // count the packets the qdisc dropped for missing their departure time, and compare the transmit timestamps to the
+    // departure times
+    void drainErrors();
 
     int fd = -1;
+    uint32_t stream_ssrc = DEFAULT_SSRC;
     bool l4s = false;
+    bool gso = false;
+    std::array<MsgPtr, udp_offload::MAX_SEGMENTS> train;
+    size_t train_length = 0;
+    bool txtime = false;
+    clockid_t txtime_clock = CLOCK_MONOTONIC;
+    std::chrono::microseconds txtime_horizon = DEFAULT_TXTIME_HORIZON;
+    // in the timebase of getTimeInNtp(), when the next packet may leave
+    uint32_t next_departure = 0;
+    // in ns on txtime_clock
+    uint64_t train_departure = 0;
+    // CLOCK_REALTIME, that of the transmit timestamps, minus txtime_clock, in ns
+    int64_t realtime_offset = 0;
+    // departure times on CLOCK_REALTIME by send, as numbered by SOF_TIMESTAMPING_OPT_ID
+    std::array<int64_t, TX_REPORT_SLOTS> tx_departures = {};
+    uint32_t tx_sends = 0;
+    bool tx_timestamps = false;
+    Scheduler::Alarm pacer;
+    // pacing accuracy since the last statistics, in us for the pacer wakeups, in ns for the departures
+    uint64_t lateness_sum = 0;
+    uint64_t lateness_max = 0;
+    uint64_t lateness_count = 0;
+    uint64_t txtime_missed = 0;
+    int64_t departure_error_sum = 0;
+    uint64_t departure_error_max = 0;
+    uint64_t departure_error_count = 0;
     ScreamV2Tx scream;
     RtpQueue rtp_queue;
     uint32_t last_log = 0;
-    spinlock lock;
 };
 
 #endif // SCREAM_SCREAMSERVERSINGLE_H
@@ -0,0 +1,28 @@
+#include "basic_rtp_generator.h"
+#include "msg_type_converter.h"
+#include "pipeline.h"
+#include "scream_v2_server_single.h"
+#include "server_types.h"
+#include "tcp_client.h"
+#include "tcp_server.h"
+#include "udp_socket.h"
+
+const std::vector<std::string> server_types::SESSION_PORTS = {
+    "proxy_audio_rtp_port", "proxy_audio_rtcp_port", "proxy_video_rtp_port", "proxy_video_rtcp_port", "proxy_input_port",
+    "game_audio_rtp_port",  "game_audio_rtcp_port",  "game_video_rtp_port",  "game_video_rtcp_port",  "game_input_port",
+};
+
+void server_types::registerTypes(Graph &graph) {
+    graph.registerType<UdpSocket>("udp_socket");
+    graph.registerType<TcpServer>("tcp_server");
+    graph.registerType<TcpClient>("tcp_client");
+    graph.registerType<BasicRtpGenerator>("basic_rtp_generator");
+    graph.registerType<ScreamV2ServerSingle>("scream_v2_server");
+    graph.registerType("scream_v2_server_l4s", [](Graph::Node &node) { node.hold(std::make_shared<ScreamV2ServerSingle>(node.name, true)); });
+    graph.registerType<MsgTypeConverter<Msg::RAW, Msg::RTP_PACKET>>("raw_to_rtp");
+    // the scream requests stay typed up to the tcp client, so that its queue coalesces them and lets them overtake the
+    // player commands, and become the json commands of the encoder as they are sent
+    using EncoderControl = Pipeline<MsgTypeConverter<Msg::BITRATE_REQUEST, Msg::RAW>::PassStage, MsgTypeConverter<Msg::IFRAME_REQUEST, Msg::RAW>::PassStage>;
+    graph.registerType("tcp_client_encoder_control",
+                       [](Graph::Node &node) { node.hold(std::make_shared<TcpClient>(node.name, std::make_unique<EncoderControl>())); });
+}
@@ -0,0 +1,17 @@
+#ifndef SCREAM_SERVERTYPES_H
+#define SCREAM_SERVERTYPES_H
+
+#include <string>
+#include <vector>
+
+#include "graph.h"
+
+// Block types of the server graphs and the ports of each session, shared by scream_server and the sessions benchmark.
+namespace server_types {
+// the ports of each session with --sessions, consecutive in this order
+extern const std::vector<std::string> SESSION_PORTS;
+
+void registerTypes(Graph &graph);
+} // namespace server_types
+
+#endif // SCREAM_SERVERTYPES_H
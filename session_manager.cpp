@@ -0,0 +1,150 @@
+extern "C" {
+#include <time.h>
+}
+
+#include <algorithm>
+
+#include "logger.h"
+#include "session_manager.h"
+
+namespace {
+std::chrono::nanoseconds processCpuTime() {
+    timespec time = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+} // namespace
+
+SessionManager::SessionManager(std::string path, std::vector<std::string> port_names, uint16_t first_port, uint16_t last_port,
+                               std::function<void(Graph &graph)> types)
+    : path(std::move(path)), port_names(std::move(port_names)), first_port(first_port), types(std::move(types)), random(std::random_device()()) {
+    const size_t ports = last_port >= first_port ? last_port - first_port + 1 : 0;
+    port_blocks.resize(this->port_names.empty() ? 0 : ports / this->port_names.size());
+}
+
+SessionManager::~SessionManager() {
+    if (running) {
+        stop();
+    }
+}
+
+bool SessionManager::start() {
+    if (running) {
+        logger::log(logger::INFO, "sessions: already started");
+        return true;
+    }
+
+    if (!classes.loadClasses(path)) {
+        return false;
+    }
+    classes.start();
+    last_wall = std::chrono::steady_clock::now();
+    last_cpu = processCpuTime();
+    running = true;
+    logger::log(logger::INFO, "sessions: up to ", port_blocks.size(), " sessions from ", path);
+    return true;
+}
+
+void SessionManager::stop() {
+    if (!running) {
+        logger::log(logger::INFO, "sessions: already stopped");
+        return;
+    }
+
+    for (const uint32_t id : list()) {
+        close(id);
+    }
+    classes.stop();
+    running = false;
+}
+
+uint32_t SessionManager::open(const std::unordered_map<std::string, std::string> &variables) {
+    std::lock_guard guard(mutex);
+    if (!running) {
+        logger::log(logger::WARNING, "sessions: not started");
+        return 0;
+    }
+
+    size_t skipped = 0;
+    while (skipped < port_blocks.size() && port_blocks[(next_block + skipped) % port_blocks.size()]) {
+        ++skipped;
+    }
+    if (skipped == port_blocks.size()) {
+        logger::log(logger::WARNING, "sessions: no ports left for a new session");
+        return 0;
+    }
+
+    const uint32_t id = next_id++;
+    Session session;
+    session.port_block = (next_block + skipped) % port_blocks.size();
+    do {
+        session.ssrc = static_cast<uint32_t>(random());
+    } while (session.ssrc == 0 ||
+             std::any_of(sessions.begin(), sessions.end(), [&session](const auto &other) { return other.second.ssrc == session.ssrc; }));
+
+    session.variables = variables;
+    session.variables["session"] = std::to_string(id);
+    session.variables["ssrc"] = std::to_string(session.ssrc);
+    for (size_t i = 0; i < port_names.size(); ++i) {
+        session.variables[port_names[i]] = std::to_string(first_port + session.port_block * port_names.size() + i);
+    }
+
+    session.graph = std::make_unique<Graph>("session " + std::to_string(id) + " ");
+    types(*session.graph);
+    if (!session.graph->load(path, session.variables, &classes)) {
+        logger::log(logger::WARNING, "sessions: fail to open session ", id);
+        return 0;
+    }
+
+    session.graph->start();
+    port_blocks[session.port_block] = true;
+    next_block = session.port_block + 1;
+    logger::log(logger::INFO, "sessions: session ", id, " opened on ports ", first_port + session.port_block * port_names.size(), " to ",
+                first_port + (session.port_block + 1) * port_names.size() - 1, ", ssrc ", session.ssrc);
+    sessions.emplace(id, std::move(session));
+    return id;
+}
+
+bool SessionManager::close(uint32_t id) {
+    std::lock_guard guard(mutex);
+    const auto it = sessions.find(id);
+    if (it == sessions.end()) {
+        logger::log(logger::WARNING, "sessions: no session ", id);
+        return false;
+    }
+
+    // stopped and gone before its ports can be handed out again
+    it->second.graph->stop();
+    it->second.graph.reset();
+    port_blocks[it->second.port_block] = false;
+    sessions.erase(it);
+    logger::log(logger::INFO, "sessions: session ", id, " closed");
+    return true;
+}
+
+std::unordered_map<std::string, std::string> SessionManager::describe(uint32_t id) {
+    std::lock_guard guard(mutex);
+    const auto it = sessions.find(id);
+    return it == sessions.end() ? std::unordered_map<std::string, std::string>() : it->second.variables;
+}
+
+std::vector<uint32_t> SessionManager::list() {
+    std::lock_guard guard(mutex);
+    std::vector<uint32_t> ids;
+    ids.reserve(sessions.size());
+    for (const auto &[id, session] : sessions) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+SessionManager::Usage SessionManager::usage() {
+    std::lock_guard guard(mutex);
+    const auto wall = std::chrono::steady_clock::now();
+    const auto cpu = processCpuTime();
+    const auto elapsed = std::chrono::duration<double>(wall - last_wall).count();
+    const Usage result = {sessions.size(), elapsed > 0 ? std::chrono::duration<double>(cpu - last_cpu).count() / elapsed : 0};
+    last_wall = wall;
+    last_cpu = cpu;
+    return result;
+}
@@ -0,0 +1,80 @@
+#ifndef SCREAM_SESSIONMANAGER_H
+#define SCREAM_SESSIONMANAGER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graph.h"
+
+// Many sessions in one process instead of one process each, every session being a Graph built on demand from the same
+// file. The classes of the file are loaded once and shared, so that all the sessions run on the same I/O and
+// scheduler threads. Each session gets a block of consecutive ports, one per name in port_names, and an ssrc of its
+// own; they are given to its graph as variables, along with "session", its id, and "ssrc". Its block names are
+// prefixed with "session <id> " in the logs.
+class SessionManager {
+  public:
+    // CPU used by the process since the previous call, 1.0 being a whole core
+    struct Usage {
+        size_t sessions;
+        double cpu;
+    };
+
+    // types registers the block types on each new graph
+    SessionManager(std::string path, std::vector<std::string> port_names, uint16_t first_port, uint16_t last_port,
+                   std::function<void(Graph &graph)> types);
+    ~SessionManager();
+
+    SessionManager(const SessionManager &) = delete;
+    SessionManager &operator=(const SessionManager &) = delete;
+
+    // load the classes of the file and start their threads
+    bool start();
+    // close the sessions left, then stop the threads
+    void stop();
+
+    // a started session, or 0 when no ports are left or the graph does not load; the variables are the ones of the file
+    // the session does not set itself
+    uint32_t open(const std::unordered_map<std::string, std::string> &variables);
+    bool close(uint32_t id);
+
+    // the variables a session was built with, ports and ssrc included, empty for an unknown one
+    std::unordered_map<std::string, std::string> describe(uint32_t id);
+    std::vector<uint32_t> list();
+
+    Usage usage();
+
+  private:
+    struct Session {
+        size_t port_block;
+        uint32_t ssrc;
+        std::unordered_map<std::string, std::string> variables;
+        std::unique_ptr<Graph> graph;
+    };
+
+    std::string path;
+    std::vector<std::string> port_names;
+    uint16_t first_port;
+    std::function<void(Graph &graph)> types;
+    Graph classes;
+
+    std::mutex mutex;
+    std::map<uint32_t, Session> sessions;
+    uint32_t next_id = 1;
+    // blocks of ports in use, handed out round robin so that a closed session's ports rest a while
+    std::vector<bool> port_blocks;
+    size_t next_block = 0;
+    std::mt19937 random;
+    bool running = false;
+    std::chrono::steady_clock::time_point last_wall;
+    std::chrono::nanoseconds last_cpu{0};
+};
+
+#endif // SCREAM_SESSIONMANAGER_H
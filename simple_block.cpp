@@ -1,7 +1,27 @@
-#include "simple_block.h"
+extern "C" {
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+}
+
+#include <array>
+#include <cstring>
+
 #include "logger.h"
+#include "simple_block.h"
+#include "sink.h"
 
-SimpleBlock::SimpleBlock(std::string name) : name(std::move(name)) {}
+SimpleBlock::SimpleBlock(std::string name) : name(std::move(name)), stop_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (stop_fd < 0) {
+        logger::log(logger::ERROR, this->name, ": fail to create stop eventfd -> ", std::strerror(errno));
+    }
+}
+
+SimpleBlock::~SimpleBlock() {
+    if (stop_fd >= 0) {
+        close(stop_fd);
+    }
+}
 
 void SimpleBlock::start() {
     if (!initialized) {
@@ -10,16 +30,47 @@ void SimpleBlock::start() {
     }
 
     if (stop_condition.load()) {
+        // the previous stop() is over, its threads are joined
+        uint64_t value;
+        (void)::read(stop_fd, &value, sizeof(value));
         stop_condition.store(false);
-        thread = std::thread(&SimpleBlock::run, this);
+        thread = spawn({}, [this] { run(); });
     } else {
         logger::log(logger::INFO, name, ": thread(s) already started");
     }
 }
 
+bool SimpleBlock::initThread(const std::string &key, const std::string &val) {
+    bool valid;
+    if (!thread_config.set(key, val, valid)) {
+        return false;
+    }
+
+    if (!valid) {
+        logger::log(logger::WARNING, name, ": invalid ", key, " ", val);
+    }
+    return true;
+}
+
+bool SimpleBlock::waitReadable(int fd, std::chrono::milliseconds timeout) {
+    std::array<pollfd, 2> fds = {{{.fd = fd, .events = POLLIN, .revents = 0}, {.fd = stop_fd, .events = POLLIN, .revents = 0}}};
+    while (poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0) {
+        if (errno != EINTR) {
+            logger::log(logger::ERROR, name, ": error while waiting for data -> ", std::strerror(errno));
+            return false;
+        }
+    }
+    return !(fds[1].revents & POLLIN);
+}
+
 void SimpleBlock::stop() {
     if (!stop_condition.load()) {
         stop_condition.store(true);
+        const uint64_t one = 1;
+        (void)::write(stop_fd, &one, sizeof(one));
+        if (auto *sink = dynamic_cast<Sink *>(this)) {
+            sink->getQueue()->wake();
+        }
         thread.join();
     } else {
         logger::log(logger::INFO, name, ": thread(s) already stopped");
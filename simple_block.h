@@ -6,10 +6,12 @@
 #include <thread>
 #include <unordered_map>
 
+#include "realtime.h"
+
 class SimpleBlock {
   public:
     explicit SimpleBlock(std::string name);
-    virtual ~SimpleBlock() = default;
+    virtual ~SimpleBlock();
 
     static constexpr uint32_t hash(std::string_view str) noexcept {
         uint32_t hash = 5381;
@@ -23,15 +25,34 @@ class SimpleBlock {
 
     virtual void init(const std::unordered_map<std::string, std::string> &params) = 0;
 
-    void start();
-    void stop();
+    virtual void start();
+    // wakes up the threads of the block, from the stop eventfd and from its queue when it is a Sink, then joins them
+    virtual void stop();
 
   protected:
     virtual void run() = 0;
 
+    // init() parameters of the block threads (see ThreadConfig::set), return false when the key is not one of them
+    bool initThread(const std::string &key, const std::string &val);
+
+    // sleep until fd is readable or timeout elapsed, or stop() is called and false is returned, fd -1 to only wait for
+    // stop(), a negative timeout for none
+    bool waitReadable(int fd, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
+
+    // helper thread of the block, configured like the main one and named after it and its role
+    template <typename F> std::thread spawn(std::string_view role, F &&f) {
+        return std::thread([this, role, f = std::forward<F>(f)]() mutable {
+            thread_config.apply(name, role);
+            f();
+        });
+    }
+
     std::string name;
+    ThreadConfig thread_config;
     bool initialized = false;
     std::atomic<bool> stop_condition = true;
+    // eventfd written by stop(), readable until the next start()
+    int stop_fd = -1;
     std::thread thread;
 };
 
@@ -1,24 +1,57 @@
 #ifndef SCREAM_SINK_H
 #define SCREAM_SINK_H
 
-#include <unordered_set>
+#include <string>
 
-#include "concurrentqueue/blockingconcurrentqueue.h"
-
-#include "source.h"
-#include "spinlock.h"
+#include "logger.h"
+#include "msg_queue.h"
 
 class Sink {
   public:
-    static constexpr auto WAIT_TIMEOUT_DELAY = std::chrono::milliseconds(100);
+    // maximum number of messages drained from the queue per wakeup
+    static constexpr size_t DEQUEUE_BULK_SIZE = 32;
+    // messages waiting before the overflow policies kick in, about 1.5 MB of full datagrams
+    static constexpr size_t DEFAULT_QUEUE_SIZE = 1024;
 
-    explicit Sink(size_t queue_size = 64) : own_queue(std::make_shared<MsgQueue>(queue_size)) {}
+    explicit Sink(std::string name, size_t queue_size = DEFAULT_QUEUE_SIZE)
+        : own_queue(std::make_shared<MsgQueue>(std::move(name), queue_size)) {}
 
     virtual ~Sink() = default;
 
     std::shared_ptr<MsgQueue> getQueue() { return own_queue; }
 
   protected:
+    // init() parameters of the queue, "queue_size", "queue_policy" (see MsgQueue::setPolicies), "lane_weights" (see
+    // MsgQueue::setWeights), "wait_strategy" (see MsgQueue::setWaitStrategy) and "spin_time" in us, return false when
+    // the key is not one of them; a producer of a "block" type sleeps until the consumer makes room but at most
+    // MsgQueue::BLOCK_TIMEOUT (100 ms), the message is then dropped and counted so that a stalled consumer cannot
+    // stall the whole graph
+    bool initQueue(const std::string &key, const std::string &val) {
+        bool valid = true;
+        if (key == "queue_size") {
+            own_queue->setCapacity(std::stoul(val));
+        } else if (key == "queue_policy") {
+            valid = own_queue->setPolicies(val);
+        } else if (key == "lane_weights") {
+            valid = own_queue->setWeights(val);
+        } else if (key == "wait_strategy") {
+            valid = own_queue->setWaitStrategy(val);
+        } else if (key == "spin_time") {
+            own_queue->setSpinTime(std::chrono::microseconds(std::stoul(val)));
+        } else {
+            return false;
+        }
+
+        if (!valid) {
+            logger::log(logger::WARNING, own_queue->getName(), ": invalid ", key, " ", val);
+        }
+        return true;
+    }
+
+    // for the blocks carrying player commands: unlike media, a command is not superseded by the next message, so a
+    // producer waits for the stream to drain as described above rather than losing one; "queue_policy" can still change it
+    void keepCommands() { own_queue->setPolicy(Msg::RAW, MsgQueue::BLOCK); }
+
     std::shared_ptr<MsgQueue> own_queue;
 };
 
@@ -1,74 +1,206 @@
 #ifndef SCREAM_SOURCE_H
 #define SCREAM_SOURCE_H
 
-#include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
-#include "concurrentqueue/blockingconcurrentqueue.h"
+#include "hybrid_lock.h"
+#include "msg.h"
+#include "msg_queue.h"
 
-#include "spinlock.h"
+// Stage a Source calls directly from its own thread instead of going through a queue, it must be thread-safe as
+// several sources may call it concurrently. The handles are given away, the handler is free to move them out.
+class MsgHandler {
+  public:
+    virtual ~MsgHandler() = default;
 
-struct Msg {
-    enum MsgType {
-        NONE,
-        RAW,
-        RTP_PACKET,
-        RTCP_PACKET,
-        BITRATE_REQUEST,
-        IFRAME_REQUEST,
-    };
+    virtual void handle(MsgPtr *msgs, size_t count) = 0;
+};
+
+// Subscribers are kept in one immutable list per message type. (Un)registering publishes a modified copy of the list
+// and forward() only loads the current one, so the packet path takes no lock and does no hashing. A replaced list may
+// still be walked by a forwarding thread, it is retired and freed by a later (un)registration once a grace period
+// passed: forward() counts itself in one of two reader counters picked by the epoch, the epoch only moves on once the
+// readers of the previous one left, and a list retired before the epoch moved is then out of reach.
+class Source {
+  public:
+    explicit Source() = default;
+    virtual ~Source() {
+        for (auto &subscribers : table) {
+            delete subscribers.load(std::memory_order::relaxed);
+        }
+    }
+
+    // messages go to the lane of their type in that queue, unless the subscription picks one, e.g. to let some RAW
+    // messages overtake the others
+    bool registerQueue(Msg::MsgType type, const std::shared_ptr<MsgQueue> &queue) { return registerQueue(type, queue, queue->getLane(type)); }
+
+    bool registerQueue(Msg::MsgType type, const std::shared_ptr<MsgQueue> &queue, MsgQueue::Lane lane) {
+        return add(type, {queue, nullptr, lane});
+    }
+
+    bool unregisterQueue(Msg::MsgType type, const std::shared_ptr<MsgQueue> &queue) { return remove(type, {queue, nullptr}); }
+
+    // the handler runs in the thread calling forward(), it must outlive its registration
+    bool registerHandler(Msg::MsgType type, MsgHandler *handler) { return add(type, {nullptr, handler}); }
 
-    MsgType type = NONE;
-    void *data = nullptr;
-    ssize_t size = 0;
-    uint64_t extra = 0;
+    bool unregisterHandler(Msg::MsgType type, MsgHandler *handler) { return remove(type, {nullptr, handler}); }
 
-    ~Msg() {
-        if (data) {
-            free(data);
+    // the last subscriber gets the handle itself, only the other ones cost a reference count increment
+    void forward(MsgPtr &&msg) {
+        const size_t side = enter();
+        const Subscribers *subscribers = table[msg->type].load(std::memory_order::acquire);
+        if (subscribers && !subscribers->empty()) {
+            const auto last = subscribers->end() - 1;
+            for (auto subscriber = subscribers->begin(); subscriber != last; ++subscriber) {
+                subscriber->deliver(MsgPtr(msg));
+            }
+            last->deliver(std::move(msg));
         }
+        leave(side);
+        msg.reset();
     }
-};
 
-using MsgQueue = moodycamel::BlockingConcurrentQueue<std::shared_ptr<const Msg>>;
+    // forward a burst, each run of messages of the same type is given to a subscriber at once, e.g. a single bulk enqueue
+    void forward(MsgPtr *msgs, size_t count) {
+        const size_t side = enter();
+        for (size_t first = 0, last; first < count; first = last) {
+            const Msg::MsgType type = msgs[first]->type;
+            for (last = first + 1; last < count && msgs[last]->type == type; ++last) {
+            }
 
-class Source {
-  public:
-    explicit Source() = default;
-    virtual ~Source() = default;
+            const Subscribers *subscribers = table[type].load(std::memory_order::acquire);
+            if (subscribers && !subscribers->empty()) {
+                const auto end = subscribers->end() - 1;
+                for (auto subscriber = subscribers->begin(); subscriber != end; ++subscriber) {
+                    subscriber->deliverCopies(msgs + first, last - first);
+                }
+                end->deliver(msgs + first, last - first);
+            }
+        }
+        leave(side);
+
+        std::for_each(msgs, msgs + count, [](MsgPtr &msg) { msg.reset(); });
+    }
+
+  private:
+    // copies given to a handler at once, a longer burst is split
+    static constexpr size_t COPY_BULK_SIZE = 32;
+
+    struct Subscriber {
+        std::shared_ptr<MsgQueue> queue;
+        MsgHandler *handler;
+        MsgQueue::Lane lane = MsgQueue::MEDIA;
 
-    bool registerQueue(Msg::MsgType type, const std::shared_ptr<MsgQueue> &queue) {
+        // a queue is subscribed once per type, whatever the lane
+        bool operator==(const Subscriber &other) const { return queue == other.queue && handler == other.handler; }
+
+        void deliver(MsgPtr &&msg) const { queue ? (void)queue->enqueue(lane, std::move(msg)) : handler->handle(&msg, 1); }
+
+        void deliver(MsgPtr *msgs, size_t count) const {
+            queue ? (void)queue->enqueue_bulk(lane, std::make_move_iterator(msgs), count) : handler->handle(msgs, count);
+        }
+
+        void deliverCopies(const MsgPtr *msgs, size_t count) const {
+            if (queue) {
+                queue->enqueue_bulk(lane, msgs, count);
+            } else {
+                std::array<MsgPtr, COPY_BULK_SIZE> copies;
+                for (size_t done = 0, chunk; done < count; done += chunk) {
+                    chunk = std::min(copies.size(), count - done);
+                    std::copy(msgs + done, msgs + done + chunk, copies.begin());
+                    handler->handle(copies.data(), chunk);
+                }
+            }
+        }
+    };
+
+    using Subscribers = std::vector<Subscriber>;
+
+    bool add(Msg::MsgType type, Subscriber &&subscriber) {
         lock.lock();
-        auto result = other_queues.try_emplace(type).first->second.emplace(queue);
+        const Subscribers *current = table[type].load(std::memory_order::relaxed);
+        const bool result = !current || std::find(current->begin(), current->end(), subscriber) == current->end();
+        if (result) {
+            auto next = current ? std::make_unique<Subscribers>(*current) : std::make_unique<Subscribers>();
+            next->push_back(std::move(subscriber));
+            publish(type, std::move(next));
+        }
         lock.unlock();
-        return result.second;
+        return result;
     }
 
-    bool unregisterQueue(Msg::MsgType type, const std::shared_ptr<MsgQueue> &queue) {
+    bool remove(Msg::MsgType type, const Subscriber &subscriber) {
         lock.lock();
-        bool result = false;
-        auto it = other_queues.find(type);
-        if (it != other_queues.end()) {
-            result = it->second.erase(queue);
+        const Subscribers *current = table[type].load(std::memory_order::relaxed);
+        const bool result = current && std::find(current->begin(), current->end(), subscriber) != current->end();
+        if (result) {
+            auto next = std::make_unique<Subscribers>(*current);
+            next->erase(std::find(next->begin(), next->end(), subscriber));
+            publish(type, std::move(next));
         }
         lock.unlock();
         return result;
     }
 
-    void forward(const std::shared_ptr<const Msg> &msg) {
-        lock.lock();
-        auto it = other_queues.find(msg->type);
-        if (it != other_queues.end()) {
-            for (auto &queue : it->second) {
-                queue->enqueue(msg);
+    struct Retired {
+        std::unique_ptr<const Subscribers> subscribers;
+        // epoch in which it was replaced
+        uint64_t epoch;
+    };
+
+    // the reader counter of the current epoch, checked again once counted in so that a reader never lands in the
+    // counter of an epoch the writer already waited for
+    size_t enter() {
+        for (;;) {
+            const uint64_t current = epoch.load();
+            const size_t side = current & 1;
+            readers[side].count.fetch_add(1);
+            if (epoch.load() == current) {
+                return side;
             }
+            readers[side].count.fetch_sub(1, std::memory_order::release);
         }
-        lock.unlock();
     }
 
-  private:
-    std::unordered_map<Msg::MsgType, std::unordered_set<std::shared_ptr<MsgQueue>>> other_queues;
-    spinlock lock;
+    void leave(size_t side) { readers[side].count.fetch_sub(1, std::memory_order::release); }
+
+    void publish(Msg::MsgType type, std::unique_ptr<Subscribers> next) {
+        std::unique_ptr<const Subscribers> previous(table[type].exchange(next.release()));
+        if (previous) {
+            retired.push_back({std::move(previous), epoch.load(std::memory_order::relaxed)});
+        }
+        reclaim();
+    }
+
+    // never waits for the readers, what cannot be freed yet is left to the next (un)registration
+    void reclaim() {
+        const uint64_t current = epoch.load(std::memory_order::relaxed);
+        if (current > 0 && readers[(current - 1) & 1].count.load() > 0) {
+            return;
+        }
+
+        // the readers of the previous epoch left, those of the current one came after the lists retired before it
+        std::erase_if(retired, [current](const Retired &entry) { return entry.epoch < current; });
+        if (!retired.empty()) {
+            epoch.store(current + 1);
+        }
+    }
+
+    struct alignas(64) Readers {
+        std::atomic<size_t> count = 0;
+    };
+
+    std::array<std::atomic<const Subscribers *>, Msg::TYPE_COUNT> table = {};
+    // lists replaced but maybe still walked by a forwarding thread
+    std::vector<Retired> retired;
+    std::atomic<uint64_t> epoch = 0;
+    std::array<Readers, 2> readers;
+    HybridLock lock;
 };
 
 #endif // SCREAM_SOURCE_H
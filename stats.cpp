@@ -0,0 +1,21 @@
+#include "hybrid_lock.h"
+#include "logger.h"
+#include "msg.h"
+#include "stats.h"
+#include "udp_socket.h"
+
+void stats::log() {
+    const auto pool = Msg::Pool::stats();
+    logger::log(logger::DEBUG, "packet pool: hits=", pool.hits, ", misses=", pool.misses, ", in use=", pool.in_use, ", high water=", pool.high_water);
+    const auto small_pool = Msg::SmallPool::stats();
+    logger::log(logger::DEBUG, "small pool: hits=", small_pool.hits, ", misses=", small_pool.misses, ", in use=", small_pool.in_use,
+                ", high water=", small_pool.high_water);
+    for (const auto &lock : HybridLock::stats()) {
+        logger::log(logger::DEBUG, lock.name, " lock: acquisitions=", lock.acquisitions, ", contended=", lock.contended, ", parked=", lock.parked,
+                    ", wait=", lock.wait_ns / 1000, "us, max wait=", lock.max_wait_ns / 1000, "us, hold=", lock.hold_ns / 1000, "us");
+    }
+    for (const auto &peer : UdpSocket::peerStats()) {
+        logger::log(logger::DEBUG, peer.name, " peer: learned=", peer.learned, ", changed=", peer.changed, ", lost=", peer.lost,
+                    ", dropped=", peer.dropped);
+    }
+}
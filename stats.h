@@ -0,0 +1,11 @@
+#ifndef SCREAM_STATS_H
+#define SCREAM_STATS_H
+
+// Process wide counters both executables dump every few seconds: the message pools, the named locks and the peers of
+// the udp sockets that learn them.
+namespace stats {
+// at DEBUG level, one line per pool, lock and peer
+void log();
+} // namespace stats
+
+#endif // SCREAM_STATS_H
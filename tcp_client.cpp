@@ -11,8 +11,12 @@ extern "C" {
 
 #include "logger.h"
 #include "tcp_client.h"
+#include "tcp_framing.h"
 
-TcpClient::TcpClient(std::string name) : SimpleBlock(std::move(name)) {}
+TcpClient::TcpClient(std::string name, std::unique_ptr<MsgTransform> pipeline)
+    : SimpleBlock(name), Sink(std::move(name)), pipeline(std::move(pipeline)) {
+    keepCommands();
+}
 
 TcpClient::~TcpClient() {
     if (fd > 0) {
@@ -40,7 +44,9 @@ void TcpClient::init(const std::unordered_map<std::string, std::string> &params)
             remote_addr.sin_port = htons(std::stoi(val));
             break;
         default:
-            std::cout << name << ": unknown key " << key << std::endl;
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                std::cout << name << ": unknown key " << key << std::endl;
+            }
             break;
         }
     }
@@ -51,11 +57,6 @@ void TcpClient::init(const std::unordered_map<std::string, std::string> &params)
         logger::log(logger::ERROR, name, ": fail to set socket reuse port -> ", std::strerror(errno));
     }
 
-    timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     if (bind(fd, (const sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to bind socket -> ", std::strerror(errno));
     }
@@ -75,31 +76,29 @@ void TcpClient::init(const std::unordered_map<std::string, std::string> &params)
 }
 
 void TcpClient::run() {
-    std::thread rx_thread(&TcpClient::read, this);
+    std::thread rx_thread = spawn("rx", [this] { read(); });
 
-    std::shared_ptr<const Msg> msg;
-    uint8_t msg_header[3] = {0xff, 0x00, 0x00};
+    std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (!own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY)) {
-            continue;
-        }
-
-        if (msg->size <= 0 || msg->type != Msg::RAW) {
-            continue;
-        }
-
-        for (size_t i = 0; i < sizeof(msg_header) - 1; i++) {
-            msg_header[sizeof(msg_header) - 1 - i] = (msg->size >> (8 * (sizeof(msg->size) - i))) & 0xff;
+        size_t count = own_queue->wait_dequeue_bulk(msgs.data(), msgs.size());
+        if (pipeline) {
+            count = pipeline->transform(msgs.data(), count);
         }
+        for (size_t n = 0; n < count; ++n) {
+            MsgPtr msg = std::move(msgs[n]);
+            if (msg->size <= 0 || msg->type != Msg::RAW) {
+                continue;
+            }
 
-        if (send(fd, msg_header, sizeof(msg_header), 0) < 0) {
-            logger::log(logger::ERROR, name, ": error while sending header -> ", std::strerror(errno));
-            continue;
-        }
+            if (msg->size > static_cast<ssize_t>(FRAME_MAX_PAYLOAD)) {
+                logger::log(logger::WARNING, name, ": message of ", msg->size, " bytes is too large to be framed");
+                continue;
+            }
 
-        if (send(fd, msg->data, msg->size, 0) < 0) {
-            logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
-            continue;
+            if (sendFrame(fd, msg) < 0) {
+                logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
+                continue;
+            }
         }
     }
 
@@ -112,22 +111,29 @@ void TcpClient::read() {
     size_t offset = 0;
     ssize_t ret;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        ret = recv(fd, buffer + offset, TCP_BUFFER_SIZE, 0);
+        ret = recv(fd, buffer + offset, TCP_BUFFER_SIZE, MSG_DONTWAIT);
         if (ret < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                waitReadable(fd);
+            } else {
                 logger::log(logger::ERROR, name, ": error while reading socket -> ", std::strerror(errno));
             }
             continue;
         }
 
-        // ret == 0 means disconnection
+        // ret == 0 means disconnection, nothing more will come
         if (ret == 0) {
+            logger::log(logger::INFO, name, ": disconnected");
+            waitReadable(-1);
             continue;
         }
 
         // std::memcpy(buffer + offset, rx_buffer, ret);
         offset += ret;
 
+        // forwarded by bursts of at most DEQUEUE_BULK_SIZE
+        std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
+        size_t count = 0;
         size_t start_offset = 0;
         static constexpr uint8_t delimiter = 0xff;
         uint16_t msg_size;
@@ -143,18 +149,21 @@ void TcpClient::read() {
                 break;
             }
 
-            auto msg = std::make_shared<Msg>();
-            msg->type = Msg::RAW;
-            msg->data = std::aligned_alloc(64, msg_size);
+            auto msg = Msg::create(Msg::RAW, msg_size);
             std::memcpy(msg->data, buffer + start_offset + sizeof(msg_size) + sizeof(delimiter), msg_size);
             msg->size = msg_size;
-            forward(msg);
-
             std::cout.write(static_cast<const char *>(msg->data), msg->size) << std::endl;
+            msgs[count++] = std::move(msg);
+            if (count == msgs.size()) {
+                forward(msgs.data(), count);
+                count = 0;
+            }
 
             start_offset += msg_size + sizeof(msg_size) + sizeof(delimiter);
         };
 
+        forward(msgs.data(), count);
+
         // consume read data
         std::memmove(buffer, buffer + start_offset, offset -= start_offset);
     }
@@ -1,6 +1,9 @@
 #ifndef SCREAM_TCPCLIENT_H
 #define SCREAM_TCPCLIENT_H
 
+#include <memory>
+
+#include "pipeline.h"
 #include "simple_block.h"
 #include "sink.h"
 #include "source.h"
@@ -9,7 +12,8 @@ class TcpClient : public SimpleBlock, public Sink, public Source {
   public:
     static constexpr size_t TCP_BUFFER_SIZE = 4096;
 
-    explicit TcpClient(std::string name);
+    // the pipeline, if any, runs on the dequeued messages before they are framed
+    explicit TcpClient(std::string name, std::unique_ptr<MsgTransform> pipeline = nullptr);
     ~TcpClient() override;
 
     void init(const std::unordered_map<std::string, std::string> &params) override;
@@ -19,6 +23,7 @@ class TcpClient : public SimpleBlock, public Sink, public Source {
     void read();
 
     int fd = -1;
+    std::unique_ptr<MsgTransform> pipeline;
 };
 
 #endif // SCREAM_TCPCLIENT_H
@@ -0,0 +1,42 @@
+#ifndef SCREAM_TCPFRAMING_H
+#define SCREAM_TCPFRAMING_H
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/uio.h>
+}
+
+#include <cstdint>
+
+#include "msg.h"
+
+// messages on the tcp command streams are prefixed by a delimiter and their size on 16 bits in network order
+constexpr uint8_t FRAME_DELIMITER = 0xff;
+constexpr size_t FRAME_HEADER_SIZE = 3;
+constexpr size_t FRAME_MAX_PAYLOAD = UINT16_MAX;
+
+// Send a message as one frame with a single syscall. When no one else holds the message, the frame header is written
+// in its headroom for the time of the send and the frame goes out as one contiguous buffer, otherwise header and payload
+// are gathered by sendmsg.
+inline ssize_t sendFrame(int fd, MsgPtr &msg) {
+    const auto size = static_cast<uint16_t>(msg->size);
+    if (msg.unique() && msg->headroom() >= FRAME_HEADER_SIZE) {
+        auto *header = static_cast<uint8_t *>(msg->pushHeader(FRAME_HEADER_SIZE));
+        header[0] = FRAME_DELIMITER;
+        header[1] = size >> 8;
+        header[2] = size & 0xff;
+        const ssize_t sent = send(fd, msg->data, msg->size, 0);
+        // the caller gets its message back as it was
+        msg->pullHeader(FRAME_HEADER_SIZE);
+        return sent;
+    }
+
+    uint8_t header[FRAME_HEADER_SIZE] = {FRAME_DELIMITER, static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size & 0xff)};
+    iovec iov[2] = {{header, sizeof(header)}, {msg->data, size}};
+    msghdr mhdr = {};
+    mhdr.msg_iov = iov;
+    mhdr.msg_iovlen = 2;
+    return sendmsg(fd, &mhdr, 0);
+}
+
+#endif // SCREAM_TCPFRAMING_H
@@ -10,9 +10,12 @@ extern "C" {
 #include <cstring>
 
 #include "logger.h"
+#include "tcp_framing.h"
 #include "tcp_server.h"
 
-TcpServer::TcpServer(std::string name) : SimpleBlock(std::move(name)) {}
+TcpServer::TcpServer(std::string name) : SimpleBlock(name), Sink(std::move(name)) {
+    keepCommands();
+}
 
 TcpServer::~TcpServer() {
     if (client_fd >= 0) {
@@ -37,7 +40,9 @@ void TcpServer::init(const std::unordered_map<std::string, std::string> &params)
             local_addr.sin_port = htons(std::stoi(val));
             break;
         default:
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
             break;
         }
     }
@@ -52,17 +57,13 @@ void TcpServer::init(const std::unordered_map<std::string, std::string> &params)
         listen_fd = -1;
     }
 
-    listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    // accepted until none is left, then polled along with the stop eventfd
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
     static constexpr int enable = 1;
     if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0) {
         logger::log(logger::ERROR, name, ": fail to set socket reuse port -> ", std::strerror(errno));
     }
 
-    timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(listen_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     if (bind(listen_fd, (const sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to bind socket -> ", std::strerror(errno));
     }
@@ -79,38 +80,36 @@ void TcpServer::init(const std::unordered_map<std::string, std::string> &params)
 }
 
 void TcpServer::run() {
-    std::thread rx_thread(&TcpServer::read, this);
-    std::thread ax_thread(&TcpServer::accept_client, this);
+    std::thread rx_thread = spawn("rx", [this] { read(); });
+    std::thread ax_thread = spawn("accept", [this] { accept_client(); });
 
-    std::shared_ptr<const Msg> msg;
-    uint8_t msg_header[3] = {0xff, 0x00, 0x00};
+    std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (!own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY)) {
-            continue;
-        }
-
-        if (msg->size <= 0 || msg->type != Msg::RAW || client_error.load(std::memory_order::relaxed)) {
-            continue;
-        }
-
-        for (size_t i = 0; i < sizeof(msg_header) - 1; i++) {
-            msg_header[sizeof(msg_header) - 1 - i] = (msg->size >> (8 * (sizeof(msg->size) - i))) & 0xff;
-        }
+        const size_t count = own_queue->wait_dequeue_bulk(msgs.data(), msgs.size());
+        for (size_t n = 0; n < count; ++n) {
+            MsgPtr msg = std::move(msgs[n]);
+            if (msg->size <= 0 || msg->type != Msg::RAW || client_error.load(std::memory_order::relaxed)) {
+                continue;
+            }
 
-        if (send(client_fd, msg_header, sizeof(msg_header), 0) < 0) {
-            logger::log(logger::ERROR, name, ": error while sending header -> ", std::strerror(errno));
-            client_error.store(true, std::memory_order::release);
-            continue;
-        }
+            if (msg->size > static_cast<ssize_t>(FRAME_MAX_PAYLOAD)) {
+                logger::log(logger::WARNING, name, ": message of ", msg->size, " bytes is too large to be framed");
+                continue;
+            }
 
-        if (send(client_fd, msg->data, msg->size, 0) < 0) {
-            logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
-            client_error.store(true, std::memory_order::release);
-            continue;
+            if (sendFrame(client_fd, msg) < 0) {
+                logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
+                client_error.store(true, std::memory_order::release);
+                continue;
+            }
         }
     }
 
     ax_thread.join();
+    // under the lock, so that the read thread cannot miss it between its check and its wait
+    {
+        std::lock_guard lk(read_m);
+    }
     read_cv.notify_all();
     rx_thread.join();
 }
@@ -131,9 +130,12 @@ void TcpServer::read() {
             continue;
         }
 
-        ret = recv(client_fd.load(std::memory_order::relaxed), buffer + offset, TCP_BUFFER_SIZE, 0);
+        const int fd = client_fd.load(std::memory_order::relaxed);
+        ret = recv(fd, buffer + offset, TCP_BUFFER_SIZE, MSG_DONTWAIT);
         if (ret < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                waitReadable(fd);
+            } else {
                 logger::log(logger::ERROR, name, ": error while reading socket -> ", std::strerror(errno));
                 client_error.store(true, std::memory_order::release);
             }
@@ -149,6 +151,9 @@ void TcpServer::read() {
         // std::memcpy(buffer + offset, rx_buffer, ret);
         offset += ret;
 
+        // forwarded by bursts of at most DEQUEUE_BULK_SIZE
+        std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
+        size_t count = 0;
         size_t start_offset = 0;
         static constexpr uint8_t delimiter = 0xff;
         uint16_t msg_size;
@@ -164,18 +169,21 @@ void TcpServer::read() {
                 break;
             }
 
-            auto msg = std::make_shared<Msg>();
-            msg->type = Msg::RAW;
-            msg->data = std::aligned_alloc(64, msg_size);
+            auto msg = Msg::create(Msg::RAW, msg_size);
             std::memcpy(msg->data, buffer + start_offset + sizeof(msg_size) + sizeof(delimiter), msg_size);
             msg->size = msg_size;
-            forward(msg);
-
             std::cout.write(static_cast<const char *>(msg->data), msg->size) << std::endl;
+            msgs[count++] = std::move(msg);
+            if (count == msgs.size()) {
+                forward(msgs.data(), count);
+                count = 0;
+            }
 
             start_offset += msg_size + sizeof(msg_size) + sizeof(delimiter);
         };
 
+        forward(msgs.data(), count);
+
         // consume read data
         std::memmove(buffer, buffer + start_offset, offset -= start_offset);
     }
@@ -187,7 +195,7 @@ void TcpServer::accept_client() {
     socklen_t len = sizeof(remote_addr);
     char remote_ip[INET_ADDRSTRLEN];
     int ret;
-    while (!stop_condition.load(std::memory_order::relaxed)) {
+    while (waitReadable(listen_fd)) {
         while ((ret = accept(listen_fd, reinterpret_cast<sockaddr *>(&remote_addr), &len)) >= 0) {
             // if already one client connected just close incoming connection
             if (client_error.load(std::memory_order::relaxed)) {
@@ -197,10 +205,6 @@ void TcpServer::accept_client() {
 
                 inet_ntop(AF_INET, &remote_addr.sin_addr, remote_ip, INET_ADDRSTRLEN);
                 logger::log(logger::INFO, name, ": connection from ", remote_ip, ':', htons(remote_addr.sin_port), " accepted");
-                timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-                if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv) < 0) {
-                    logger::log(logger::ERROR, name, ": fail to set client socket timeout -> ", std::strerror(errno));
-                }
                 client_error.store(false, std::memory_order::release);
                 read_cv.notify_all();
             } else {
@@ -209,7 +213,7 @@ void TcpServer::accept_client() {
             }
         }
 
-        if (ret < 0 && (errno != EAGAIN || errno != EWOULDBLOCK)) {
+        if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
             logger::log(logger::ERROR, name, ": error during accept ->", std::strerror(errno));
         }
     }
@@ -0,0 +1,124 @@
+#include <bit>
+#include <limits>
+
+#include "timer_wheel.h"
+
+void TimerWheel::add(Timer &timer, Clock::time_point deadline) {
+    if (timer.scheduled) {
+        remove(timer);
+    }
+
+    timer.deadline = deadline;
+    insert(timer);
+    ++count;
+}
+
+void TimerWheel::remove(Timer &timer) {
+    if (!timer.scheduled) {
+        return;
+    }
+
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        slots[timer.level][timer.slot] = timer.next;
+        if (!timer.next) {
+            occupied[timer.level] &= ~(uint64_t{1} << timer.slot);
+        }
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    timer.prev = nullptr;
+    timer.next = nullptr;
+    timer.scheduled = false;
+    --count;
+}
+
+TimerWheel::Clock::time_point TimerWheel::next() const {
+    const uint64_t tick = nextTick();
+    if (tick == std::numeric_limits<uint64_t>::max()) {
+        return Clock::time_point::max();
+    }
+    return Clock::time_point(std::chrono::duration_cast<Clock::duration>(tick * TICK));
+}
+
+void TimerWheel::insert(Timer &timer) {
+    // overdue ones go in the current slot, farther than the last level in its farthest slot, they come back there
+    const uint64_t tick = std::max(ceilTicks(timer.deadline), current);
+    const uint64_t delta = std::min(tick - current, (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1);
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >> (SLOT_BITS * (level + 1)) != 0) {
+        ++level;
+    }
+
+    const auto slot = static_cast<uint8_t>(((current + delta) >> (SLOT_BITS * level)) & (SLOTS - 1));
+    Timer *&head = slots[level][slot];
+    timer.level = static_cast<uint8_t>(level);
+    timer.slot = slot;
+    timer.prev = nullptr;
+    timer.next = head;
+    if (head) {
+        head->prev = &timer;
+    }
+    head = &timer;
+    occupied[level] |= uint64_t{1} << slot;
+    timer.scheduled = true;
+}
+
+uint64_t TimerWheel::nextTick() const {
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    if (occupied[0]) {
+        best = current + std::countr_zero(std::rotr(occupied[0], static_cast<int>(current & (SLOTS - 1))));
+    }
+
+    // the slot of a level comes up when the level below wraps around, the current one did already
+    for (unsigned level = 1; level < LEVELS; ++level) {
+        if (!occupied[level]) {
+            continue;
+        }
+        const unsigned shift = SLOT_BITS * level;
+        const uint64_t base = current >> shift;
+        const uint64_t ahead = std::countr_zero(std::rotr(occupied[level], static_cast<int>((base + 1) & (SLOTS - 1)))) + 1;
+        best = std::min(best, (base + ahead) << shift);
+    }
+    return best;
+}
+
+void TimerWheel::cascade() {
+    // coarsest first, its timers may land in the finer slots coming up at the same tick
+    for (unsigned level = LEVELS - 1; level > 0; --level) {
+        const unsigned shift = SLOT_BITS * level;
+        const auto slot = static_cast<unsigned>((current >> shift) & (SLOTS - 1));
+        if ((current & ((uint64_t{1} << shift) - 1)) != 0 || !(occupied[level] & (uint64_t{1} << slot))) {
+            continue;
+        }
+
+        Timer *timer = std::exchange(slots[level][slot], nullptr);
+        occupied[level] &= ~(uint64_t{1} << slot);
+        while (timer) {
+            Timer *next = timer->next;
+            insert(*timer);
+            timer = next;
+        }
+    }
+}
+
+void LatenessHistogram::record(std::chrono::nanoseconds lateness) {
+    const auto us = static_cast<uint64_t>(std::max<int64_t>(lateness.count(), 0) / 1000);
+    const size_t bucket = std::min<size_t>(std::bit_width(us), BUCKETS - 1);
+    counts[bucket].fetch_add(1, std::memory_order::relaxed);
+}
+
+std::string LatenessHistogram::report() {
+    std::string text;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        const uint64_t total = count(bucket);
+        if (const uint64_t n = total - reported[bucket]; n > 0) {
+            text += (text.empty() ? "" : " ") + std::string(bucket == BUCKETS - 1 ? ">=" : "<") +
+                    std::to_string(uint64_t{1} << (bucket == BUCKETS - 1 ? bucket - 1 : bucket)) + "us:" + std::to_string(n);
+        }
+        reported[bucket] = total;
+    }
+    return text;
+}
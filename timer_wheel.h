@@ -0,0 +1,97 @@
+#ifndef SCREAM_TIMERWHEEL_H
+#define SCREAM_TIMERWHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+// Hierarchical timing wheel with a 1 us tick: LEVELS wheels of SLOTS slots, each slot of a level spanning a whole turn
+// of the level below. Adding and removing a timer are O(1), and timers only move to a finer level when their slot
+// comes up, at most once per level, so that many tasks pacing at high rates cost no sorted container. A timer is
+// never due before its deadline, rounded up to the tick.
+class TimerWheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto TICK = std::chrono::microseconds(1);
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1 << SLOT_BITS;
+    // 64 us, 4 ms, 262 ms, 16.8 s, 17.9 min then 19 h per level, farther deadlines wait on the last one
+    static constexpr unsigned LEVELS = 6;
+
+    // intrusive, e.g. a base of what waits on it, in at most one wheel at a time
+    struct Timer {
+        Clock::time_point deadline;
+        Timer *prev = nullptr;
+        Timer *next = nullptr;
+        uint8_t level = 0;
+        uint8_t slot = 0;
+        bool scheduled = false;
+    };
+
+    explicit TimerWheel(Clock::time_point now = Clock::now()) : current(floorTicks(now)) {}
+
+    void add(Timer &timer, Clock::time_point deadline);
+    void remove(Timer &timer);
+    bool empty() const { return count == 0; }
+
+    // when advance() next has something to do, a deadline or timers to move to a finer level, max() when empty
+    Clock::time_point next() const;
+
+    // call f(Timer &) on every timer due at now, already removed, it may add timers again
+    template <typename F> void advance(Clock::time_point now, F &&f) {
+        const uint64_t target = floorTicks(now);
+        for (uint64_t tick; (tick = nextTick()) <= target;) {
+            current = tick;
+            cascade();
+            Timer *timer = std::exchange(slots[0][current & (SLOTS - 1)], nullptr);
+            occupied[0] &= ~(uint64_t{1} << (current & (SLOTS - 1)));
+            while (timer) {
+                Timer *next = timer->next;
+                timer->scheduled = false;
+                --count;
+                f(*timer);
+                timer = next;
+            }
+        }
+        current = std::max(current, target);
+    }
+
+  private:
+    static uint64_t floorTicks(Clock::time_point time) { return static_cast<uint64_t>(time.time_since_epoch() / TICK); }
+    static uint64_t ceilTicks(Clock::time_point time) {
+        return static_cast<uint64_t>(std::chrono::ceil<std::chrono::microseconds>(time.time_since_epoch()) / TICK);
+    }
+
+    void insert(Timer &timer);
+    uint64_t nextTick() const;
+    // the timers of the slots coming up at the current tick go down
+    void cascade();
+
+    uint64_t current;
+    size_t count = 0;
+    std::array<uint64_t, LEVELS> occupied = {};
+    std::array<std::array<Timer *, SLOTS>, LEVELS> slots = {};
+};
+
+// How late timers fire, in power of two buckets from under 1 us to 16 ms and more. Written by one thread, read by any.
+class LatenessHistogram {
+  public:
+    static constexpr size_t BUCKETS = 16;
+
+    void record(std::chrono::nanoseconds lateness);
+
+    // counts since the previous call, e.g. "<1us:120 <2us:31 <4us:2", empty when there were none
+    std::string report();
+
+    uint64_t count(size_t bucket) const { return counts[bucket].load(std::memory_order::relaxed); }
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts = {};
+    std::array<uint64_t, BUCKETS> reported = {};
+};
+
+#endif // SCREAM_TIMERWHEEL_H
@@ -0,0 +1,42 @@
+extern "C" {
+#include <netinet/in.h>
+#include <netinet/udp.h>
+}
+
+#include <cstring>
+
+#include "udp_offload.h"
+
+namespace udp_offload {
+bool gsoSupported(int fd) {
+    int segment_size = 0;
+    socklen_t size = sizeof(segment_size);
+    return getsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment_size, &size) == 0;
+}
+
+bool enableGro(int fd) {
+    static constexpr int enable = 1;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+}
+
+void setSegmentSize(msghdr &header, void *control, uint16_t segment_size) {
+    header.msg_control = control;
+    header.msg_controllen = CMSG_SPACE(sizeof(segment_size));
+    cmsghdr *cmhdr = CMSG_FIRSTHDR(&header);
+    cmhdr->cmsg_level = SOL_UDP;
+    cmhdr->cmsg_type = UDP_SEGMENT;
+    cmhdr->cmsg_len = CMSG_LEN(sizeof(segment_size));
+    std::memcpy(CMSG_DATA(cmhdr), &segment_size, sizeof(segment_size));
+}
+
+size_t segmentSize(msghdr &header) {
+    for (cmsghdr *cmhdr = CMSG_FIRSTHDR(&header); cmhdr != nullptr; cmhdr = CMSG_NXTHDR(&header, cmhdr)) {
+        if (cmhdr->cmsg_level == SOL_UDP && cmhdr->cmsg_type == UDP_GRO) {
+            int segment_size;
+            std::memcpy(&segment_size, CMSG_DATA(cmhdr), sizeof(segment_size));
+            return segment_size > 0 ? static_cast<size_t>(segment_size) : 0;
+        }
+    }
+    return 0;
+}
+} // namespace udp_offload
@@ -0,0 +1,36 @@
+#ifndef SCREAM_UDP_OFFLOAD_H
+#define SCREAM_UDP_OFFLOAD_H
+
+extern "C" {
+#include <sys/socket.h>
+}
+
+#include <cstddef>
+#include <cstdint>
+
+// UDP segmentation offloads of Linux: with GSO, one send of a train of same size datagrams, the last one possibly
+// shorter, is split by the kernel or the NIC; with GRO, datagrams of the same flow arriving together come back from one
+// receive, along with the size they are to be split at.
+namespace udp_offload {
+// datagrams per GSO send, the kernel takes up to 64 as long as they fit in 64 KiB
+constexpr size_t MAX_SEGMENTS = 32;
+// largest GRO receive
+constexpr size_t MAX_COALESCED_SIZE = 65535;
+// room for the control message of either
+constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+
+// false when the kernel has no GSO, before Linux 4.18
+bool gsoSupported(int fd);
+
+// false when the kernel has no GRO for UDP, before Linux 5.0
+bool enableGro(int fd);
+
+// make the datagrams of header one train of segment_size segments, control holds CONTROL_SIZE bytes aligned as a
+// cmsghdr and must live until the send
+void setSegmentSize(msghdr &header, void *control, uint16_t segment_size);
+
+// segment size of a received datagram, 0 when it was not coalesced
+size_t segmentSize(msghdr &header);
+} // namespace udp_offload
+
+#endif // SCREAM_UDP_OFFLOAD_H
@@ -1,28 +1,77 @@
 extern "C" {
 #include <arpa/inet.h>
+#ifdef SCREAM_IO_URING
+#include <sys/eventfd.h>
+#endif
 #include <netinet/in.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 }
 
+#include <algorithm>
 #include <cstring>
+#include <memory>
+#include <mutex>
 
 #include "logger.h"
+#include "udp_offload.h"
 #include "udp_socket.h"
+#ifdef SCREAM_IO_URING
+#include "uring.h"
+#endif
 
-UdpSocket::UdpSocket(std::string name) : SimpleBlock(std::move(name)) {}
+static_assert(UdpSocket::UDP_BUFFER_SIZE <= Msg::CAPACITY, "a datagram must fit in a pooled message");
+static_assert(udp_offload::MAX_SEGMENTS * Msg::CAPACITY <= udp_offload::MAX_COALESCED_SIZE, "a GSO train must fit in 64 KiB");
+
+namespace {
+struct Registry {
+    std::mutex mutex;
+    std::vector<const UdpSocket *> sockets;
+};
+
+Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+
+int64_t steadyNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+UdpSocket::UdpSocket(std::string name) : SimpleBlock(name), Sink(std::move(name)) {}
 
 UdpSocket::~UdpSocket() {
     if (fd >= 0) {
         close(fd);
     }
+    if (notify_fd >= 0) {
+        own_queue->setNotifier(-1);
+        close(notify_fd);
+    }
+    if (peer_timer_fd >= 0) {
+        close(peer_timer_fd);
+    }
+    for (void *block : rx_blocks) {
+        if (block) {
+            Msg::releasePacket(block);
+        }
+    }
+    if (registered) {
+        Registry &sockets = registry();
+        std::lock_guard guard(sockets.mutex);
+        std::erase(sockets.sockets, this);
+    }
 }
 
 void UdpSocket::init(const std::unordered_map<std::string, std::string> &params) {
     sockaddr_in local_addr = {AF_INET, 0, {}, {}};
     remote_addr = {AF_INET, 0, {}, {}};
+    // learning by default when no remote port is given
+    int learn = -1;
     for (auto const &[key, val] : params) {
         logger::log(logger::DEBUG, name, ": ", key, " = ", val);
         switch (hash(key)) {
@@ -39,8 +88,37 @@ void UdpSocket::init(const std::unordered_map<std::string, std::string> &params)
         case hash("remote_port"sv):
             remote_addr.sin_port = htons(std::stoi(val));
             break;
+        case hash("learn_peer"sv):
+            learn = val == "true" || val == "1";
+            break;
+        case hash("peer_timeout"sv):
+            peer_timeout = std::chrono::milliseconds(std::stoul(val));
+            break;
+        case hash("batch_size"sv):
+            batch_size = std::clamp<size_t>(std::stoul(val), 1, MAX_BATCH_SIZE);
+            break;
+        case hash("gso"sv):
+            gso = val == "true" || val == "1";
+            break;
+        case hash("gro"sv):
+            gro = val == "true" || val == "1";
+            break;
+        case hash("io_backend"sv):
+#ifdef SCREAM_IO_URING
+            io_backend = val == "io_uring" ? IO_URING : SYSCALL;
+#else
+            if (val == "io_uring") {
+                logger::log(logger::WARNING, name, ": built without io_uring support, using system calls");
+            }
+#endif
+            break;
+        case hash("io_uring_sqpoll"sv):
+            sqpoll = val == "true" || val == "1";
+            break;
         default:
-            logger::log(logger::WARNING, name, ": unknown key ", key);
+            if (!initQueue(key, val) && !initThread(key, val)) {
+                logger::log(logger::WARNING, name, ": unknown key ", key);
+            }
             break;
         }
     }
@@ -61,69 +139,624 @@ void UdpSocket::init(const std::unordered_map<std::string, std::string> &params)
         logger::log(logger::ERROR, name, ": fail to set socket buffer size -> ", std::strerror(errno));
     }
 
-    timeval tv = {.tv_sec = 0, .tv_usec = 100'000};
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv) < 0) {
-        logger::log(logger::ERROR, name, ": fail to set socket timeout -> ", std::strerror(errno));
-    }
-
     if (bind(fd, (const sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
         logger::log(logger::ERROR, name, ": fail to bind socket -> ", std::strerror(errno));
     }
 
-    /*if (connect(fd, (const sockaddr *)(&remote_addr), sizeof(remote_addr)) < 0) {
-        logger::log(logger::ERROR, name, ": fail to connect socket -> ", std::strerror(errno));
-    }*/
+    if (gso && !udp_offload::gsoSupported(fd)) {
+        logger::log(logger::WARNING, name, ": no UDP GSO in this kernel, sending datagrams one by one");
+        gso = false;
+    }
+    if (gro && !udp_offload::enableGro(fd)) {
+        logger::log(logger::WARNING, name, ": fail to enable UDP GRO -> ", std::strerror(errno));
+        gro = false;
+    }
+    gro_buffer.resize(gro ? GRO_BATCH_SIZE * udp_offload::MAX_COALESCED_SIZE : 0);
+
+    // connected once the peer is known, see learnPeer()
+    learn_peer = learn >= 0 ? learn == 1 : remote_addr.sin_port == 0;
+#ifdef SCREAM_IO_URING
+    if (learn_peer && io_backend == IO_URING) {
+        logger::log(logger::WARNING, name, ": no peer learning with io_uring, using system calls");
+        io_backend = SYSCALL;
+    }
+#endif
+    has_peer.store(remote_addr.sin_port != 0);
+    connected.store(false);
+    if (learn_peer && !registered) {
+        Registry &sockets = registry();
+        std::lock_guard guard(sockets.mutex);
+        sockets.sockets.push_back(this);
+        registered = true;
+    }
 
     char local_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &local_addr.sin_addr.s_addr, local_ip, INET_ADDRSTRLEN);
     char remote_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &remote_addr.sin_addr.s_addr, remote_ip, INET_ADDRSTRLEN);
     logger::log(logger::INFO, name, ": will listen on ", local_ip, ':', ntohs(local_addr.sin_port), " and send data to ", remote_ip, ':',
-                ntohs(remote_addr.sin_port));
+                ntohs(remote_addr.sin_port), learn_peer ? " until it learns its peer" : "");
 
     initialized = true;
 }
 
+void UdpSocket::start() {
+    if (!reactor) {
+        SimpleBlock::start();
+        return;
+    }
+
+    if (!initialized) {
+        logger::log(logger::INFO, name, ": you need to init me first");
+    } else if (stop_condition.load()) {
+        stop_condition.store(false);
+        reactor->add(this, fd, own_queue);
+        // without its own receiving thread, the socket needs a timer to notice a silent peer when nothing is sent
+        if (learn_peer) {
+            if (peer_timer_fd < 0) {
+                peer_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            }
+            peer_timer_armed = false;
+            reactor->add(this, peer_timer_fd, nullptr);
+        }
+    } else {
+        logger::log(logger::INFO, name, ": thread(s) already started");
+    }
+}
+
+void UdpSocket::stop() {
+    if (!reactor) {
+        SimpleBlock::stop();
+        return;
+    }
+
+    if (!stop_condition.load()) {
+        stop_condition.store(true);
+        reactor->remove(this);
+    } else {
+        logger::log(logger::INFO, name, ": thread(s) already stopped");
+    }
+}
+
+void UdpSocket::onReadable() {
+    // either the socket or the peer timer, the other one has nothing to read then
+    if (peer_timer_fd >= 0) {
+        uint64_t expirations;
+        if (::read(peer_timer_fd, &expirations, sizeof(expirations)) > 0) {
+            peer_timer_armed = false;
+        }
+    }
+    receive(REACTOR_BUDGET, MSG_DONTWAIT);
+
+    // armed once per silence to watch for, not on every datagram
+    if (const auto left = checkPeer(); peer_timer_fd >= 0 && !peer_timer_armed && left.count() > 0) {
+        itimerspec deadline = {};
+        deadline.it_value.tv_sec = left.count() / 1000000000;
+        deadline.it_value.tv_nsec = left.count() % 1000000000;
+        timerfd_settime(peer_timer_fd, 0, &deadline, nullptr);
+        peer_timer_armed = true;
+    }
+}
+
+UdpSocket::PeerStats UdpSocket::getPeerStats() const {
+    return {
+        name,
+        learned.load(std::memory_order::relaxed),
+        changed.load(std::memory_order::relaxed),
+        lost.load(std::memory_order::relaxed),
+        dropped.load(std::memory_order::relaxed),
+    };
+}
+
+std::vector<UdpSocket::PeerStats> UdpSocket::peerStats() {
+    Registry &sockets = registry();
+    std::lock_guard guard(sockets.mutex);
+    std::vector<PeerStats> stats;
+    stats.reserve(sockets.sockets.size());
+    for (const UdpSocket *socket : sockets.sockets) {
+        stats.push_back(socket->getPeerStats());
+    }
+    return stats;
+}
+
+void UdpSocket::onQueue() {
+    std::array<MsgPtr, MAX_BATCH_SIZE> msgs;
+    for (size_t sent = 0, count; sent < REACTOR_BUDGET && (count = own_queue->try_dequeue_bulk(msgs.data(), batch_size)) > 0; sent += count) {
+        send(msgs.data(), count);
+    }
+}
+
 void UdpSocket::run() {
-    std::thread rx_thread(&UdpSocket::read, this);
+#ifdef SCREAM_IO_URING
+    if (io_backend == IO_URING && runIoUring()) {
+        return;
+    }
+#endif
+
+    std::thread rx_thread = spawn("rx", [this] { read(); });
     logger::log(logger::INFO, name, ": spawn an additional thread for read operation");
 
-    std::shared_ptr<const Msg> msg;
+    std::array<MsgPtr, MAX_BATCH_SIZE> msgs;
     while (!stop_condition.load(std::memory_order::relaxed)) {
-        if (own_queue->wait_dequeue_timed(msg, WAIT_TIMEOUT_DELAY) && msg->size > 0) {
-            ssize_t size = sendto(fd, msg->data, msg->size, 0, reinterpret_cast<sockaddr *>(&remote_addr), sizeof(remote_addr));
-            if (size < 0) {
+        send(msgs.data(), own_queue->wait_dequeue_bulk(msgs.data(), batch_size));
+    }
+
+    rx_thread.join();
+}
+
+void UdpSocket::read() {
+    // the socket is drained before sleeping on it, and the sleep ends in time to notice the peer going silent, as there
+    // may be nothing to send
+    auto timeout = [this] {
+        const auto left = checkPeer();
+        return left.count() < 0 ? std::chrono::milliseconds(-1) : std::chrono::ceil<std::chrono::milliseconds>(left);
+    };
+    while (waitReadable(fd, timeout())) {
+        receive(REACTOR_BUDGET, MSG_DONTWAIT);
+    }
+}
+
+void UdpSocket::send(MsgPtr *msgs, size_t count) {
+    using Control = std::array<uint8_t, udp_offload::CONTROL_SIZE>;
+    std::array<mmsghdr, MAX_BATCH_SIZE> headers;
+    std::array<iovec, MAX_BATCH_SIZE> iovs;
+    alignas(cmsghdr) std::array<Control, MAX_BATCH_SIZE> controls;
+
+    checkPeer();
+    if (!has_peer.load(std::memory_order::acquire)) {
+        dropped.fetch_add(std::count_if(msgs, msgs + count, [](const MsgPtr &msg) { return msg->size > 0; }), std::memory_order::relaxed);
+        std::for_each(msgs, msgs + count, [](MsgPtr &msg) { msg.reset(); });
+        return;
+    }
+    // a connected socket sends to its peer without an address
+    peer_lock.lock();
+    sockaddr_in destination = remote_addr;
+    const bool to_peer = connected.load(std::memory_order::relaxed);
+    peer_lock.unlock();
+
+    for (size_t next = 0; next < count;) {
+        const size_t first = next;
+        size_t batch = 0;
+        size_t iov_count = 0;
+        for (; next < count && batch < batch_size && iov_count < iovs.size(); ++next) {
+            if (msgs[next]->size <= 0) {
+                continue;
+            }
+
+            iovec &iov = iovs[iov_count++];
+            iov = {msgs[next]->data, static_cast<size_t>(msgs[next]->size)};
+            // joins the train of the previous datagram when as long as its first one, or shorter to end it
+            if (gso && batch > 0) {
+                msghdr &train = headers[batch - 1].msg_hdr;
+                const size_t segment_size = train.msg_iov[0].iov_len;
+                if (train.msg_iovlen < udp_offload::MAX_SEGMENTS && train.msg_iov[train.msg_iovlen - 1].iov_len == segment_size &&
+                    iov.iov_len <= segment_size) {
+                    ++train.msg_iovlen;
+                    continue;
+                }
+            }
+
+            headers[batch] = {};
+            headers[batch].msg_hdr.msg_name = to_peer ? nullptr : &destination;
+            headers[batch].msg_hdr.msg_namelen = to_peer ? 0 : sizeof(destination);
+            headers[batch].msg_hdr.msg_iov = &iov;
+            headers[batch].msg_hdr.msg_iovlen = 1;
+            ++batch;
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            if (headers[i].msg_hdr.msg_iovlen > 1) {
+                udp_offload::setSegmentSize(headers[i].msg_hdr, controls[i].data(), headers[i].msg_hdr.msg_iov[0].iov_len);
+            }
+        }
+
+        // sendmmsg stops at the first datagram failing, it is skipped and the ones after it go on the next call
+        for (size_t sent = 0; sent < batch;) {
+            const int ret = sendmmsg(fd, headers.data() + sent, batch - sent, 0);
+            // the headers left were built for the connected socket, without an address: once the peer is forgotten,
+            // here or by another thread meanwhile, the rest of the burst is dropped until the peer is learned again
+            if (ret < 0 && (errno == ECONNREFUSED || errno == EDESTADDRREQ) && learn_peer) {
+                if (errno == ECONNREFUSED) {
+                    forgetPeer("refused");
+                }
+                size_t left = std::count_if(msgs + next, msgs + count, [](const MsgPtr &msg) { return msg->size > 0; });
+                for (size_t i = sent; i < batch; ++i) {
+                    left += headers[i].msg_hdr.msg_iovlen;
+                }
+                dropped.fetch_add(left, std::memory_order::relaxed);
+                std::for_each(msgs + first, msgs + count, [](MsgPtr &msg) { msg.reset(); });
+                return;
+            } else if (ret < 0) {
                 logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(errno));
+                // the device cannot segment, e.g. without checksum offload
+                if (errno == EIO && headers[sent].msg_hdr.msg_iovlen > 1) {
+                    logger::log(logger::WARNING, name, ": UDP GSO refused, sending datagrams one by one");
+                    gso = false;
+                }
             }
+            sent += ret > 0 ? ret : 1;
         }
+        std::for_each(msgs + first, msgs + next, [](MsgPtr &msg) { msg.reset(); });
+    }
+}
+
+void UdpSocket::receive(size_t budget, int flags) {
+    if (gro) {
+        receiveCoalesced(budget, flags);
+        return;
     }
 
-    rx_thread.join();
+    std::array<mmsghdr, MAX_BATCH_SIZE> headers;
+    std::array<iovec, MAX_BATCH_SIZE> iovs;
+    std::array<MsgPtr, MAX_BATCH_SIZE> received;
+    std::array<sockaddr_in, MAX_BATCH_SIZE> sources;
+    for (size_t done = 0; done < budget;) {
+        const size_t count = std::min(batch_size, budget - done);
+        for (size_t i = 0; i < count; ++i) {
+            if (!rx_blocks[i]) {
+                rx_blocks[i] = Msg::reservePacket();
+            }
+            iovs[i] = {Msg::packetPayload(rx_blocks[i]), UDP_BUFFER_SIZE};
+            headers[i] = {};
+            headers[i].msg_hdr.msg_name = &sources[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int ret = recvmmsg(fd, headers.data(), count, flags, nullptr);
+        if (ret < 0) {
+            if (errno == ECONNREFUSED && learn_peer) {
+                forgetPeer("refused");
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logger::log(logger::ERROR, name, ": error while reading socket -> ", std::strerror(errno));
+            }
+            return;
+        }
+        if (learn_peer && ret > 0) {
+            learnPeer(sources[ret - 1]);
+        }
+
+        // the blocks of empty datagrams stay for the next call
+        size_t filled = 0;
+        for (int i = 0; i < ret; ++i) {
+            if (headers[i].msg_len > 0) {
+                received[filled++] = Msg::fromPacket(std::exchange(rx_blocks[i], nullptr), Msg::RAW, headers[i].msg_len);
+            }
+        }
+        forward(received.data(), filled);
+
+        done += ret;
+        if (static_cast<size_t>(ret) < count) {
+            return;
+        }
+    }
 }
 
-void UdpSocket::read() {
-    alignas(64) uint8_t rx_buffer[UDP_BUFFER_SIZE];
-    sockaddr_in addr;
-    socklen_t addr_len = sizeof(addr);
-    while (!stop_condition.load(std::memory_order::relaxed)) {
-        ssize_t ret = recvfrom(fd, rx_buffer, UDP_BUFFER_SIZE, 0, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+void UdpSocket::receiveCoalesced(size_t budget, int flags) {
+    using Control = std::array<uint8_t, udp_offload::CONTROL_SIZE>;
+    std::array<mmsghdr, GRO_BATCH_SIZE> headers;
+    std::array<iovec, GRO_BATCH_SIZE> iovs;
+    alignas(cmsghdr) std::array<Control, GRO_BATCH_SIZE> controls;
+    std::array<MsgPtr, MAX_BATCH_SIZE> received;
+    std::array<sockaddr_in, GRO_BATCH_SIZE> sources;
+    for (size_t done = 0; done < budget;) {
+        const size_t count = std::min(GRO_BATCH_SIZE, budget - done);
+        for (size_t i = 0; i < count; ++i) {
+            iovs[i] = {gro_buffer.data() + i * udp_offload::MAX_COALESCED_SIZE, udp_offload::MAX_COALESCED_SIZE};
+            headers[i] = {};
+            headers[i].msg_hdr.msg_name = &sources[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_control = controls[i].data();
+            headers[i].msg_hdr.msg_controllen = controls[i].size();
+        }
+
+        const int ret = recvmmsg(fd, headers.data(), count, flags, nullptr);
         if (ret < 0) {
-            if (errno != EAGAIN || errno != EWOULDBLOCK) {
-                std::cerr << name << ": error while reading socket -> " << std::strerror(errno) << std::endl;
+            if (errno == ECONNREFUSED && learn_peer) {
+                forgetPeer("refused");
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logger::log(logger::ERROR, name, ": error while reading socket -> ", std::strerror(errno));
+            }
+            return;
+        }
+        if (learn_peer && ret > 0) {
+            learnPeer(sources[ret - 1]);
+        }
+
+        size_t filled = 0;
+        for (int i = 0; i < ret; ++i) {
+            const size_t size = headers[i].msg_len;
+            const size_t segment_size = udp_offload::segmentSize(headers[i].msg_hdr);
+            const size_t step = segment_size > 0 ? segment_size : size;
+            for (size_t offset = 0; offset < size; offset += step) {
+                const size_t length = std::min(step, size - offset);
+                auto msg = Msg::create(Msg::RAW, length);
+                std::memcpy(msg->data, static_cast<uint8_t *>(iovs[i].iov_base) + offset, length);
+                msg->size = static_cast<ssize_t>(length);
+                received[filled++] = std::move(msg);
+                if (filled == received.size()) {
+                    forward(received.data(), filled);
+                    filled = 0;
+                }
             }
-            continue;
         }
+        forward(received.data(), filled);
 
-        if (ret <= 0) {
-            continue;
+        done += ret;
+        if (static_cast<size_t>(ret) < count) {
+            return;
         }
+    }
+}
+
+void UdpSocket::learnPeer(const sockaddr_in &source) {
+    // once connected, only the peer's datagrams come in
+    last_heard.store(steadyNow(), std::memory_order::relaxed);
+    if (connected.load(std::memory_order::acquire)) {
+        return;
+    }
+
+    peer_lock.lock();
+    const bool other = source.sin_addr.s_addr != remote_addr.sin_addr.s_addr || source.sin_port != remote_addr.sin_port;
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&source), sizeof(source)) < 0) {
+        logger::log(logger::ERROR, name, ": fail to connect socket -> ", std::strerror(errno));
+    } else {
+        if (other && learned.load(std::memory_order::relaxed) > 0) {
+            changed.fetch_add(1, std::memory_order::relaxed);
+        }
+        learned.fetch_add(1, std::memory_order::relaxed);
+        remote_addr = source;
+        has_peer.store(true, std::memory_order::release);
+        connected.store(true, std::memory_order::release);
+
+        char remote_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &source.sin_addr.s_addr, remote_ip, INET_ADDRSTRLEN);
+        logger::log(logger::INFO, name, ": peer learned, now sending data to ", remote_ip, ':', ntohs(source.sin_port));
+    }
+    peer_lock.unlock();
+}
+
+void UdpSocket::forgetPeer(const char *reason) {
+    peer_lock.lock();
+    if (connected.load(std::memory_order::relaxed)) {
+        // the local address stays bound
+        const sockaddr unspecified = {.sa_family = AF_UNSPEC, .sa_data = {}};
+        connect(fd, &unspecified, sizeof(unspecified));
+        connected.store(false, std::memory_order::release);
+        lost.fetch_add(1, std::memory_order::relaxed);
+        logger::log(logger::INFO, name, ": peer lost (", reason, "), learning it again");
+    }
+    peer_lock.unlock();
+}
+
+std::chrono::nanoseconds UdpSocket::checkPeer() {
+    if (!learn_peer || !connected.load(std::memory_order::acquire)) {
+        return std::chrono::nanoseconds(-1);
+    }
+
+    const auto left = std::chrono::nanoseconds(last_heard.load(std::memory_order::relaxed) - steadyNow()) + peer_timeout;
+    if (left.count() <= 0) {
+        forgetPeer("silent");
+        return std::chrono::nanoseconds(-1);
+    }
+    return left;
+}
+
+#ifdef SCREAM_IO_URING
+bool UdpSocket::runIoUring() {
+    static constexpr uint16_t RECV_GROUP = 0;
+    enum : uint64_t {
+        RECV_TAG = 1,
+        NOTIFY_TAG,
+        CANCEL_TAG,
+        // followed by the send slot index
+        SEND_TAG,
+    };
+
+    struct SendSlot {
+        msghdr header;
+        iovec iov;
+        MsgPtr msg;
+    };
+
+    // all the kernel may still write into or read from, leaked instead of freed when it does not let go at stop
+    struct InFlight {
+        IoUring ring;
+        std::vector<void *> buffers = std::vector<void *>(URING_BUFFER_COUNT);
+        std::vector<SendSlot> slots = std::vector<SendSlot>(URING_SEND_SLOTS);
+        uint64_t notify_value;
+    };
+    auto in_flight = std::make_unique<InFlight>();
+    IoUring &ring = in_flight->ring;
+    if (!ring.init(URING_ENTRIES, sqpoll) || !ring.setupBufferRing(RECV_GROUP, URING_BUFFER_COUNT)) {
+        logger::log(logger::WARNING, name, ": io_uring unavailable, back to system calls -> ", std::strerror(errno));
+        return false;
+    }
 
-        // std::cout << ret << std::endl;
-        auto msg = std::make_shared<Msg>();
-        msg->type = Msg::RAW;
-        msg->data = std::aligned_alloc(64, ret);
-        std::memcpy(msg->data, rx_buffer, ret);
-        msg->size = ret;
-        forward(msg);
+    if (notify_fd < 0) {
+        notify_fd = eventfd(0, EFD_CLOEXEC);
+    }
+    own_queue->setNotifier(notify_fd);
+
+    // pool blocks lent to the kernel, a received datagram turns its block into a message and a new block takes its id
+    std::vector<void *> &buffers = in_flight->buffers;
+    for (uint16_t id = 0; id < URING_BUFFER_COUNT; ++id) {
+        buffers[id] = Msg::reservePacket();
+        ring.addBuffer(Msg::packetPayload(buffers[id]), UDP_BUFFER_SIZE, id);
+    }
+    ring.commitBuffers();
+
+    std::vector<SendSlot> &slots = in_flight->slots;
+    std::vector<size_t> free_slots;
+    for (size_t i = URING_SEND_SLOTS; i > 0; --i) {
+        free_slots.push_back(i - 1);
+    }
+
+    bool recv_armed = false;
+    bool notify_armed = false;
+    uint64_t &notify_value = in_flight->notify_value;
+    std::vector<MsgPtr> received;
+    received.reserve(URING_BUFFER_COUNT);
+
+    auto handle = [&](const io_uring_cqe &cqe) {
+        switch (cqe.user_data) {
+        case RECV_TAG:
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (cqe.res > 0) {
+                    received.push_back(Msg::fromPacket(buffers[id], Msg::RAW, cqe.res));
+                    buffers[id] = Msg::reservePacket();
+                }
+                ring.addBuffer(Msg::packetPayload(buffers[id]), UDP_BUFFER_SIZE, id);
+            }
+            if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+                logger::log(logger::ERROR, name, ": error while reading socket -> ", std::strerror(-cqe.res));
+            }
+            // out of buffers or stopped, armed again on the next round
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                recv_armed = false;
+            }
+            break;
+        case NOTIFY_TAG:
+            notify_armed = false;
+            break;
+        case CANCEL_TAG:
+            break;
+        default: {
+            const size_t slot = cqe.user_data - SEND_TAG;
+            if (cqe.res < 0) {
+                logger::log(logger::ERROR, name, ": error while sending data -> ", std::strerror(-cqe.res));
+            }
+            slots[slot].msg.reset();
+            free_slots.push_back(slot);
+            break;
+        }
+        }
+    };
+
+    // the multishot receive came with Linux 6.0, older kernels refuse it at once instead of arming it, which would
+    // otherwise be retried in a loop
+    auto arm_recv = [&] {
+        if (io_uring_sqe *sqe = ring.getSqe()) {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = RECV_GROUP;
+            sqe->user_data = RECV_TAG;
+            recv_armed = true;
+        }
+    };
+    arm_recv();
+    ring.submit(1, URING_PROBE_TIMEOUT);
+    bool refused = false;
+    ring.reap([&](const io_uring_cqe &cqe) {
+        if (cqe.user_data == RECV_TAG && cqe.res == -EINVAL) {
+            refused = true;
+            recv_armed = false;
+        } else {
+            handle(cqe);
+        }
+    });
+    if (refused) {
+        logger::log(logger::WARNING, name, ": no multishot receive in this kernel, back to system calls");
+        own_queue->setNotifier(-1);
+        for (void *buffer : buffers) {
+            Msg::releasePacket(buffer);
+        }
+        return false;
+    }
+    logger::log(logger::INFO, name, ": io_uring backend", sqpoll ? " with SQPOLL" : "");
+
+    std::array<MsgPtr, DEQUEUE_BULK_SIZE> msgs;
+    while (!stop_condition.load(std::memory_order::relaxed)) {
+        if (!recv_armed) {
+            arm_recv();
+        }
+        if (!notify_armed) {
+            if (io_uring_sqe *sqe = ring.getSqe()) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = notify_fd;
+                sqe->addr = reinterpret_cast<uint64_t>(&notify_value);
+                sqe->len = sizeof(notify_value);
+                sqe->user_data = NOTIFY_TAG;
+                notify_armed = true;
+            }
+        }
+
+        // all the sends of a burst go in the same submission, nowhere to send them without a remote port
+        for (size_t count; !free_slots.empty() && (count = own_queue->try_dequeue_bulk(msgs.data(), std::min(msgs.size(), free_slots.size()))) > 0;) {
+            if (!has_peer.load(std::memory_order::relaxed)) {
+                dropped.fetch_add(std::count_if(msgs.begin(), msgs.begin() + count, [](const MsgPtr &msg) { return msg->size > 0; }),
+                                  std::memory_order::relaxed);
+                std::for_each(msgs.begin(), msgs.begin() + count, [](MsgPtr &msg) { msg.reset(); });
+                continue;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                io_uring_sqe *sqe = msgs[i]->size > 0 ? ring.getSqe() : nullptr;
+                if (!sqe && msgs[i]->size > 0) {
+                    ring.submit();
+                    sqe = ring.getSqe();
+                }
+                if (!sqe) {
+                    msgs[i].reset();
+                    continue;
+                }
+
+                const size_t slot = free_slots.back();
+                free_slots.pop_back();
+                SendSlot &send = slots[slot];
+                send.iov = {msgs[i]->data, static_cast<size_t>(msgs[i]->size)};
+                send.header = {};
+                send.header.msg_name = &remote_addr;
+                send.header.msg_namelen = sizeof(remote_addr);
+                send.header.msg_iov = &send.iov;
+                send.header.msg_iovlen = 1;
+                send.msg = std::move(msgs[i]);
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<uint64_t>(&send.header);
+                sqe->len = 1;
+                sqe->user_data = SEND_TAG + slot;
+            }
+        }
+
+        // only sleep with nothing left to send, or nowhere to send it from; stop() wakes the queue, so the eventfd
+        const bool idle = own_queue->arm() || free_slots.empty();
+        ring.submit(idle ? 1 : 0);
+        ring.reap(handle);
+        ring.commitBuffers();
+        forward(received.data(), received.size());
+        received.clear();
+    }
+
+    // the kernel must be done with the buffers and the messages being sent before they go back to the pool
+    own_queue->setNotifier(-1);
+    for (const uint64_t tag : {RECV_TAG, NOTIFY_TAG}) {
+        if (io_uring_sqe *sqe = ring.getSqe()) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = tag;
+            sqe->user_data = CANCEL_TAG;
+        }
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while ((recv_armed || notify_armed || free_slots.size() < URING_SEND_SLOTS) && std::chrono::steady_clock::now() < deadline) {
+        ring.submit(1, deadline - std::chrono::steady_clock::now());
+        ring.reap(handle);
+    }
+    received.clear();
+
+    // the provided buffers, the messages being sent and the ring itself must outlive whatever the kernel still holds
+    if (recv_armed || notify_armed || free_slots.size() < URING_SEND_SLOTS) {
+        logger::log(logger::ERROR, name, ": io_uring operations still pending at stop, their buffers are leaked");
+        in_flight.release();
+        return true;
+    }
+    for (void *buffer : buffers) {
+        Msg::releasePacket(buffer);
     }
+    return true;
 }
+#endif
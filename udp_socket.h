@@ -5,25 +5,140 @@ extern "C" {
 #include <netinet/in.h>
 }
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "hybrid_lock.h"
+#include "reactor.h"
 #include "simple_block.h"
 #include "sink.h"
 #include "source.h"
 
-class UdpSocket : public SimpleBlock, public Sink, public Source {
+// Either runs its own sending and receiving threads, or, once attached to a Reactor, is driven by one of its I/O
+// threads. Datagrams go through recvmmsg and sendmmsg in batches of up to "batch_size", received straight into pooled
+// buffers that become messages without a copy and are forwarded as one burst. With "gso", same size messages queued
+// after each other leave as one GSO train; with "gro", coalesced datagrams are received into a larger buffer and split
+// back into one message per datagram. With the io_uring backend ("io_backend" = "io_uring"), a single thread receives
+// through a multishot receive (Linux 6.0) into pooled buffers that become messages without a copy, and submits each
+// burst of sends at once; older kernels fall back to system calls.
+//
+// With "learn_peer", the default when "remote_port" is 0, the peer is the source of the first datagram received: the
+// socket connects to it, so that sends go without an address and the kernel hands over the peer's datagrams only. When
+// the peer goes away, refused by ICMP or silent for "peer_timeout" (in ms), the socket disconnects and learns the next
+// one, sending to the last one meanwhile. A learning socket always uses the system call backend; without a peer,
+// whatever the backend, messages are dropped and counted.
+class UdpSocket : public SimpleBlock, public Sink, public Source, public IoHandler {
   public:
     static constexpr size_t UDP_BUFFER_SIZE = 1472;
+    // datagrams read or messages sent per reactor event, so that a busy socket does not starve the others
+    static constexpr size_t REACTOR_BUDGET = 64;
+    // datagrams per recvmmsg or sendmmsg call
+    static constexpr size_t DEFAULT_BATCH_SIZE = 32;
+    static constexpr size_t MAX_BATCH_SIZE = 64;
+    // coalesced datagrams per recvmmsg call with GRO, each up to udp_offload::MAX_COALESCED_SIZE
+    static constexpr size_t GRO_BATCH_SIZE = 4;
+    static constexpr auto DEFAULT_PEER_TIMEOUT = std::chrono::milliseconds(2000);
+#ifdef SCREAM_IO_URING
+    static constexpr unsigned URING_ENTRIES = 256;
+    // receive buffers lent to the kernel, a power of 2
+    static constexpr unsigned URING_BUFFER_COUNT = 256;
+    // sends in flight
+    static constexpr size_t URING_SEND_SLOTS = 128;
+    // how long the first receive is given to be refused by a kernel without multishot receive
+    static constexpr auto URING_PROBE_TIMEOUT = std::chrono::milliseconds(10);
+#endif
+
+    struct PeerStats {
+        std::string name;
+        // connected to a peer, the first one or not
+        uint64_t learned;
+        // learned a peer other than the previous one
+        uint64_t changed;
+        // disconnected from a peer gone away
+        uint64_t lost;
+        // messages with no peer to go to yet
+        uint64_t dropped;
+    };
 
     explicit UdpSocket(std::string name);
     ~UdpSocket() override;
 
     void init(const std::unordered_map<std::string, std::string> &params) override;
 
+    // before start(), nullptr to get the threads back
+    void attach(Reactor *reactor) { this->reactor = reactor; }
+
+    void start() override;
+    void stop() override;
+
+    void onReadable() override;
+    void onQueue() override;
+
+    PeerStats getPeerStats() const;
+
+    // of the sockets learning their peer
+    static std::vector<PeerStats> peerStats();
+
   private:
+    enum IoBackend {
+        SYSCALL,
+        IO_URING,
+    };
+
     void run() override;
+#ifdef SCREAM_IO_URING
+    // false when io_uring cannot be set up, nothing was done then
+    bool runIoUring();
+#endif
     void read();
+    // in batches of batch_size, a datagram failing to go is reported and skipped
+    void send(MsgPtr *msgs, size_t count);
+    // up to budget datagrams, stop once the socket is drained when flags has MSG_DONTWAIT
+    void receive(size_t budget, int flags);
+    // same with GRO, each segment copied into a message of its own
+    void receiveCoalesced(size_t budget, int flags);
+    // from the receiving thread, with the source of the latest datagram
+    void learnPeer(const sockaddr_in &source);
+    // back to learning, from either thread
+    void forgetPeer(const char *reason);
+    // forget the peer once silent for peer_timeout, from either thread; how long it can still stay silent, negative
+    // when there is no peer to lose
+    std::chrono::nanoseconds checkPeer();
 
     int fd = -1;
+    size_t batch_size = DEFAULT_BATCH_SIZE;
+    // pool blocks the next recvmmsg fills, kept from one call to the next; only the receiving thread touches them
+    std::array<void *, MAX_BATCH_SIZE> rx_blocks = {};
+    bool gso = false;
+    bool gro = false;
+    // GRO_BATCH_SIZE buffers of udp_offload::MAX_COALESCED_SIZE, only with GRO
+    std::vector<uint8_t> gro_buffer;
+    // changes under peer_lock when learning the peer
     sockaddr_in remote_addr;
+    bool learn_peer = false;
+    bool registered = false;
+    std::chrono::milliseconds peer_timeout = DEFAULT_PEER_TIMEOUT;
+    HybridLock peer_lock;
+    // a peer to send to, learned or given
+    std::atomic<bool> has_peer = false;
+    std::atomic<bool> connected = false;
+    // steady clock time of the latest datagram from the peer, in ns
+    std::atomic<int64_t> last_heard = 0;
+    // timerfd for checkPeer() with a reactor, set on the next expected silence once a peer is learned
+    int peer_timer_fd = -1;
+    bool peer_timer_armed = false;
+    std::atomic<uint64_t> learned = 0;
+    std::atomic<uint64_t> changed = 0;
+    std::atomic<uint64_t> lost = 0;
+    std::atomic<uint64_t> dropped = 0;
+    Reactor *reactor = nullptr;
+    IoBackend io_backend = SYSCALL;
+    bool sqpoll = false;
+    // eventfd the queue writes to for the io_uring backend, kept open as long as the socket as producers may hold it
+    int notify_fd = -1;
 };
 
 #endif // SCREAM_UDPSOCKET_H
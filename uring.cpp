@@ -0,0 +1,178 @@
+extern "C" {
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "uring.h"
+
+IoUring::~IoUring() {
+    if (buf_ring) {
+        munmap(buf_ring, buf_ring_size);
+    }
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool IoUring::init(unsigned entries, bool sqpoll) {
+    io_uring_params params = {};
+    if (sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 100;
+    }
+
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        return false;
+    }
+    // waiting with a timeout needs it (5.11)
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+        return false;
+    }
+    this->sqpoll = sqpoll;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        return false;
+    }
+    cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+        cq_ring = nullptr;
+        return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        sqes = nullptr;
+        return false;
+    }
+
+    auto *sq = static_cast<uint8_t *>(sq_ring);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_flags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sqe_head = sqe_tail = *sq_tail;
+
+    auto *cq = static_cast<uint8_t *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    return true;
+}
+
+io_uring_sqe *IoUring::getSqe() {
+    const unsigned head = std::atomic_ref<unsigned>(*sq_head).load(std::memory_order::acquire);
+    if (sqe_tail - head >= sq_entries) {
+        return nullptr;
+    }
+
+    io_uring_sqe *sqe = &sqes[sqe_tail++ & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit(unsigned wait_nr, std::chrono::nanoseconds timeout) {
+    const unsigned to_submit = sqe_tail - sqe_head;
+    for (; sqe_head != sqe_tail; ++sqe_head) {
+        sq_array[sqe_head & sq_mask] = sqe_head & sq_mask;
+    }
+    std::atomic_ref<unsigned>(*sq_tail).store(sqe_tail, std::memory_order::release);
+
+    unsigned flags = 0;
+    if (sqpoll) {
+        // the kernel thread sees the new tail by itself, unless it fell asleep
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (std::atomic_ref<unsigned>(*sq_flags).load(std::memory_order::relaxed) & IORING_SQ_NEED_WAKEUP) {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        } else if (wait_nr == 0) {
+            return static_cast<int>(to_submit);
+        }
+    } else if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+
+    if (wait_nr == 0) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, 0, flags, nullptr, 0));
+    }
+
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout.count() == 0) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, nullptr, 0));
+    }
+
+    const __kernel_timespec ts = {
+        .tv_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout).count(),
+        .tv_nsec = (timeout % std::chrono::seconds(1)).count(),
+    };
+    io_uring_getevents_arg arg = {};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    flags |= IORING_ENTER_EXT_ARG;
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, &arg, sizeof(arg)));
+}
+
+bool IoUring::setupBufferRing(uint16_t group, unsigned entries) {
+    buf_ring_size = entries * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+
+    io_uring_buf_reg reg = {};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, buf_ring_size);
+        return false;
+    }
+
+    buf_ring = static_cast<io_uring_buf_ring *>(ring);
+    buf_mask = entries - 1;
+    return true;
+}
+
+void IoUring::addBuffer(void *addr, unsigned len, uint16_t id) {
+    // not through bufs[], the empty struct the header uses for it in C++ shifts it by 8 bytes
+    io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(buf_ring)[static_cast<uint16_t>(buf_tail + buf_added) & buf_mask];
+    buf.addr = reinterpret_cast<uint64_t>(addr);
+    buf.len = len;
+    buf.bid = id;
+    ++buf_added;
+}
+
+void IoUring::commitBuffers() {
+    if (buf_added == 0) {
+        return;
+    }
+
+    buf_tail += buf_added;
+    buf_added = 0;
+    std::atomic_ref<uint16_t>(buf_ring->tail).store(buf_tail, std::memory_order::release);
+}
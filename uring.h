@@ -0,0 +1,88 @@
+#ifndef SCREAM_URING_H
+#define SCREAM_URING_H
+
+extern "C" {
+#include <linux/io_uring.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Bare io_uring on top of the system calls: the submission and completion queues mapped in memory, plus an optional
+// ring of provided buffers the kernel picks from for receive operations. A ring belongs to the thread driving it.
+// Only UdpSocket drives one so far, the tcp blocks and the scream blocks still go through system calls.
+class IoUring {
+  public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // false with errno set when io_uring is denied or lacks a needed feature; with sqpoll a kernel thread picks the
+    // submissions up, so that submitting costs no system call while it is awake
+    bool init(unsigned entries, bool sqpoll);
+
+    // cleared submission entry, nullptr when the queue is full and needs a submit()
+    io_uring_sqe *getSqe();
+
+    // submit the entries got so far and wait for wait_nr completions, up to timeout when not zero
+    int submit(unsigned wait_nr = 0, std::chrono::nanoseconds timeout = {});
+
+    // call f on every completion available, return how many there were
+    template <typename F> unsigned reap(F &&f);
+
+    // ring of buffers used by operations with IOSQE_BUFFER_SELECT on this group, entries is a power of 2
+    bool setupBufferRing(uint16_t group, unsigned entries);
+
+    // handed to the kernel at the next commitBuffers()
+    void addBuffer(void *addr, unsigned len, uint16_t id);
+    void commitBuffers();
+
+  private:
+    int fd = -1;
+    bool sqpoll = false;
+
+    void *sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void *cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned *sq_head = nullptr;
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_flags = nullptr;
+    unsigned *sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    // entries got but not submitted yet lie between these two
+    unsigned sqe_head = 0;
+    unsigned sqe_tail = 0;
+
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned cq_mask = 0;
+
+    io_uring_buf_ring *buf_ring = nullptr;
+    size_t buf_ring_size = 0;
+    unsigned buf_mask = 0;
+    uint16_t buf_tail = 0;
+    uint16_t buf_added = 0;
+};
+
+template <typename F> unsigned IoUring::reap(F &&f) {
+    unsigned head = *cq_head;
+    const unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order::acquire);
+    const unsigned count = tail - head;
+    for (; head != tail; ++head) {
+        f(cqes[head & cq_mask]);
+    }
+    std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order::release);
+    return count;
+}
+
+#endif // SCREAM_URING_H